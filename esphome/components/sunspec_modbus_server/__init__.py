@@ -1,5 +1,6 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome.core import CORE
 from esphome.const import (
     CONF_ID,
@@ -19,21 +20,42 @@ from esphome.const import (
     DEVICE_CLASS_ENERGY,
     STATE_CLASS_MEASUREMENT,
     STATE_CLASS_TOTAL_INCREASING,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    CONF_INTERVAL,
+    CONF_SIZE,
 )
 from esphome.components import sensor
 from esphome.components import number
 
 CODEOWNERS = ["@mahoekst"]
-DEPENDENCIES = ["wifi"]
+DEPENDENCIES = ["network"]
 AUTO_LOAD = ["sensor", "number"]
+MULTI_CONF = True
 
 CONF_UNIT_ID = "unit_id"
+CONF_SERVER_ID = "server_id"
 CONF_TARGET_POWER_LIMIT = "target_power_limit"
+CONF_POWER_LIMIT_DEADBAND = "power_limit_deadband"
+CONF_POWER_LIMIT_INTERVAL = "power_limit_interval"
+CONF_CLOSED_LOOP = "closed_loop"
+CONF_BANDWIDTH = "bandwidth"
+CONF_RESPONSE_TIME = "response_time"
+CONF_PROPORTIONAL_GAIN = "proportional_gain"
 CONF_MANUFACTURER = "manufacturer"
 CONF_MODEL = "model"
 CONF_SERIAL = "serial"
 CONF_VERSION = "version"
 CONF_MAX_POWER = "max_power"
+CONF_MAX_CLIENTS = "max_clients"
+CONF_CLIENT_TIMEOUT = "client_timeout"
+CONF_EVENT_DRIVEN = "event_driven"
+CONF_DEDICATED_TASK = "dedicated_task"
+CONF_TASK_CORE = "task_core"
+CONF_RESTORE_STATE = "restore_state"
+CONF_PERSIST_INTERVAL = "persist_interval"
+CONF_ALLOCATION_CHECK = "allocation_check"
+CONF_MODEL_120 = "model_120"
+CONF_MODEL_160 = "model_160"
 
 # Source sensor configuration keys (input from external sensors like modbus_controller)
 CONF_SOURCE_AC_POWER = "source_ac_power"
@@ -71,15 +93,232 @@ CONF_DC_VOLTAGE = "dc_voltage"
 CONF_DC_CURRENT = "dc_current"
 CONF_DC_POWER = "dc_power"
 CONF_TEMPERATURE = "temperature"
+CONF_CHANGE_ONLY = "change_only"
+CONF_DEADBAND = "deadband"
+CONF_HEARTBEAT = "heartbeat"
+CONF_SUPPRESSED_PUBLISHES = "suppressed_publishes"
+CONF_DIAGNOSTICS = "diagnostics"
+CONF_LATENCY = "latency"
+CONF_CONTROL_TOLERANCE = "control_tolerance"
+CONF_HEAP_FREE = "heap_free"
+CONF_HEAP_LARGEST_BLOCK = "heap_largest_block"
+CONF_HISTORY = "history"
+CONF_STALE_TIMEOUT = "stale_timeout"
+CONF_POLLING = "polling"
+CONF_COMPONENT = "component"
+CONF_SOURCES = "sources"
+CONF_IDLE_INTERVAL = "idle_interval"
+CONF_P50 = "p50"
+CONF_P99 = "p99"
+CONF_MAX = "max"
 
 sunspec_modbus_server_ns = cg.esphome_ns.namespace("sunspec_modbus_server")
 SunSpecModbusServer = sunspec_modbus_server_ns.class_("SunSpecModbusServer", cg.Component)
 
 SENSOR_SCHEMA = sensor.sensor_schema()
 
+ValueField = sunspec_modbus_server_ns.enum("ValueField")
+
+# Source sensor key → inverter value it feeds; only configured sources are added
+SOURCE_FIELDS = {
+    CONF_SOURCE_AC_POWER: ValueField.FIELD_AC_POWER,
+    CONF_SOURCE_VOLTAGE_A: ValueField.FIELD_AC_VOLTAGE_A,
+    CONF_SOURCE_VOLTAGE_B: ValueField.FIELD_AC_VOLTAGE_B,
+    CONF_SOURCE_VOLTAGE_C: ValueField.FIELD_AC_VOLTAGE_C,
+    CONF_SOURCE_CURRENT_A: ValueField.FIELD_AC_CURRENT_A,
+    CONF_SOURCE_CURRENT_B: ValueField.FIELD_AC_CURRENT_B,
+    CONF_SOURCE_CURRENT_C: ValueField.FIELD_AC_CURRENT_C,
+    CONF_SOURCE_FREQUENCY: ValueField.FIELD_FREQUENCY,
+    CONF_SOURCE_POWER_FACTOR: ValueField.FIELD_POWER_FACTOR,
+    CONF_SOURCE_TOTAL_ENERGY: ValueField.FIELD_TOTAL_ENERGY,
+    CONF_SOURCE_DC_VOLTAGE: ValueField.FIELD_DC_VOLTAGE,
+    CONF_SOURCE_DC_CURRENT: ValueField.FIELD_DC_CURRENT,
+    CONF_SOURCE_DC_POWER: ValueField.FIELD_DC_POWER,
+    CONF_SOURCE_TEMPERATURE: ValueField.FIELD_TEMPERATURE,
+    CONF_SOURCE_PV2_VOLTAGE: ValueField.FIELD_PV2_VOLTAGE,
+    CONF_SOURCE_PV2_CURRENT: ValueField.FIELD_PV2_CURRENT,
+    CONF_SOURCE_PV2_POWER: ValueField.FIELD_PV2_POWER,
+    CONF_SOURCE_INVERTER_STATUS: ValueField.FIELD_INVERTER_STATUS,
+}
+
+# Output sensor key → inverter value it publishes
+OUTPUT_FIELDS = {
+    CONF_AC_POWER: ValueField.FIELD_AC_POWER,
+    CONF_AC_VOLTAGE_A: ValueField.FIELD_AC_VOLTAGE_A,
+    CONF_AC_VOLTAGE_B: ValueField.FIELD_AC_VOLTAGE_B,
+    CONF_AC_VOLTAGE_C: ValueField.FIELD_AC_VOLTAGE_C,
+    CONF_AC_CURRENT_A: ValueField.FIELD_AC_CURRENT_A,
+    CONF_AC_CURRENT_B: ValueField.FIELD_AC_CURRENT_B,
+    CONF_AC_CURRENT_C: ValueField.FIELD_AC_CURRENT_C,
+    CONF_AC_CURRENT_TOTAL: ValueField.FIELD_AC_CURRENT_TOTAL,
+    CONF_FREQUENCY: ValueField.FIELD_FREQUENCY,
+    CONF_POWER_FACTOR: ValueField.FIELD_POWER_FACTOR,
+    CONF_TOTAL_ENERGY: ValueField.FIELD_TOTAL_ENERGY,
+    CONF_DC_VOLTAGE: ValueField.FIELD_DC_VOLTAGE,
+    CONF_DC_CURRENT: ValueField.FIELD_DC_CURRENT,
+    CONF_DC_POWER: ValueField.FIELD_DC_POWER,
+    CONF_TEMPERATURE: ValueField.FIELD_TEMPERATURE,
+}
+
+ServerCounter = sunspec_modbus_server_ns.enum("ServerCounter")
+
+# Diagnostic sensor keys → server counter (same order as the diagnostic register block)
+DIAGNOSTIC_COUNTERS = {
+    "requests_read_holding": ServerCounter.COUNTER_READ_HOLDING,
+    "requests_read_input": ServerCounter.COUNTER_READ_INPUT,
+    "requests_write_single": ServerCounter.COUNTER_WRITE_SINGLE,
+    "requests_write_multiple": ServerCounter.COUNTER_WRITE_MULTIPLE,
+    "requests_unsupported": ServerCounter.COUNTER_OTHER_FUNCTION,
+    "exceptions_illegal_function": ServerCounter.COUNTER_EX_ILLEGAL_FUNCTION,
+    "exceptions_illegal_address": ServerCounter.COUNTER_EX_ILLEGAL_ADDRESS,
+    "exceptions_illegal_value": ServerCounter.COUNTER_EX_ILLEGAL_VALUE,
+    "bytes_in": ServerCounter.COUNTER_BYTES_IN,
+    "bytes_out": ServerCounter.COUNTER_BYTES_OUT,
+    "dropped_protocol": ServerCounter.COUNTER_DROPPED_PROTOCOL,
+    "dropped_unit_id": ServerCounter.COUNTER_DROPPED_UNIT,
+    "invalid_frames": ServerCounter.COUNTER_INVALID_FRAMES,
+    "accepts": ServerCounter.COUNTER_ACCEPTS,
+    "rejects": ServerCounter.COUNTER_REJECTS,
+    "timeouts": ServerCounter.COUNTER_TIMEOUTS,
+    "cache_hits": ServerCounter.COUNTER_CACHE_HITS,
+    "cache_misses": ServerCounter.COUNTER_CACHE_MISSES,
+    "requests_read_write_multiple": ServerCounter.COUNTER_READ_WRITE_MULTIPLE,
+    "requests_device_id": ServerCounter.COUNTER_DEVICE_ID,
+}
+
+def _validate_publish(config):
+    # deadband and heartbeat only apply to change-only publishing, which they turn on
+    if config.get(CONF_CHANGE_ONLY) is False:
+        for key in (CONF_DEADBAND, CONF_HEARTBEAT):
+            if key in config:
+                raise cv.Invalid(f"{key} requires {CONF_CHANGE_ONLY}: true")
+    return config
+
+
+def output_sensor_schema(**kwargs):
+    return cv.All(
+        sensor.sensor_schema(**kwargs).extend(
+            {
+                cv.Optional(CONF_CHANGE_ONLY): cv.boolean,
+                cv.Optional(CONF_DEADBAND): cv.positive_float,
+                cv.Optional(CONF_HEARTBEAT): cv.positive_time_period_milliseconds,
+            }
+        ),
+        _validate_publish,
+    )
+
+
+DIAGNOSTICS_SCHEMA = cv.Schema(
+    {
+        cv.Optional(key): sensor.sensor_schema(
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        )
+        for key in DIAGNOSTIC_COUNTERS
+    }
+).extend(
+    {
+        # Heap fragmentation shows as a shrinking largest block while free heap stays flat
+        cv.Optional(key): sensor.sensor_schema(
+            unit_of_measurement="B",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        )
+        for key in (CONF_HEAP_FREE, CONF_HEAP_LARGEST_BLOCK)
+    }
+)
+
+LatencyMetric = sunspec_modbus_server_ns.enum("LatencyMetric")
+LatencyStat = sunspec_modbus_server_ns.enum("LatencyStat")
+
+# Latency histogram keys → metric (request handling, loop() total and per phase, then the
+# Model 123 control path)
+LATENCY_METRICS = {
+    "request": LatencyMetric.LATENCY_REQUEST,
+    "loop": LatencyMetric.LATENCY_LOOP,
+    "source_update": LatencyMetric.LATENCY_SOURCE_UPDATE,
+    "register_update": LatencyMetric.LATENCY_REGISTER_UPDATE,
+    "sensor_publish": LatencyMetric.LATENCY_SENSOR_PUBLISH,
+    "revert_check": LatencyMetric.LATENCY_REVERT_CHECK,
+    "client_handling": LatencyMetric.LATENCY_CLIENT_HANDLING,
+    "control_dispatch": LatencyMetric.LATENCY_CONTROL_DISPATCH,
+    "control_forward": LatencyMetric.LATENCY_CONTROL_FORWARD,
+    "control_ack": LatencyMetric.LATENCY_CONTROL_ACK,
+    "control_settle": LatencyMetric.LATENCY_CONTROL_SETTLE,
+    "control_total": LatencyMetric.LATENCY_CONTROL_TOTAL,
+}
+
+LATENCY_STATS = {
+    CONF_P50: LatencyStat.LATENCY_P50,
+    CONF_P99: LatencyStat.LATENCY_P99,
+    CONF_MAX: LatencyStat.LATENCY_MAX,
+}
+
+LATENCY_SENSOR_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement="µs",
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+LATENCY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_INTERVAL, default="60s"): cv.positive_time_period_milliseconds,
+        # AC power within this many percent of max_power above the limit counts as settled
+        cv.Optional(CONF_CONTROL_TOLERANCE, default=2.0): cv.float_range(min=0.0, max=100.0),
+        **{
+            cv.Optional(key): cv.Schema({cv.Optional(stat): LATENCY_SENSOR_SCHEMA for stat in LATENCY_STATS})
+            for key in LATENCY_METRICS
+        },
+    }
+)
+
+HISTORY_SCHEMA = cv.Schema(
+    {
+        # RAM for the ring; 128-byte blocks of ~10 samples each
+        cv.Optional(CONF_SIZE, default=4096): cv.int_range(min=256, max=32768),
+        cv.Optional(CONF_INTERVAL, default="60s"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(seconds=1))
+        ),
+    }
+)
+
+# PI trim of the power limit against source_ac_power
+CLOSED_LOOP_SCHEMA = cv.Schema(
+    {
+        # Integral action: 2π·bandwidth % rate per second per % error
+        cv.Optional(CONF_BANDWIDTH, default="0.02Hz"): cv.All(cv.frequency, cv.Range(min=0.001, max=1.0)),
+        # How long the inverter takes to follow a new active power rate
+        cv.Optional(CONF_RESPONSE_TIME, default="3s"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=100))
+        ),
+        cv.Optional(CONF_PROPORTIONAL_GAIN, default=0.0): cv.float_range(min=0.0, max=2.0),
+    }
+)
+
+# A component (growatt_solar, modbus_controller) that the server updates at the rate
+# clients read the values of the listed sources (default: all configured sources)
+POLLER_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_COMPONENT): cv.use_id(cg.PollingComponent),
+        cv.Optional(CONF_SOURCES): cv.ensure_list(cv.one_of(*SOURCE_FIELDS, lower=True)),
+        # A period of 0 would update the component on every pass of run_pollers_()
+        cv.Optional(CONF_INTERVAL, default="1s"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=100))
+        ),
+        cv.Optional(CONF_IDLE_INTERVAL, default="30s"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=100))
+        ),
+    }
+)
+
 CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(SunSpecModbusServer),
+        # Serve this device from another instance's TCP server under its own unit ID
+        cv.Optional(CONF_SERVER_ID): cv.use_id(SunSpecModbusServer),
         cv.Optional(CONF_PORT, default=502): cv.port,
         cv.Optional(CONF_UNIT_ID, default=1): cv.int_range(min=1, max=247),
         cv.Optional(CONF_MANUFACTURER, default="Growatt"): cv.string,
@@ -88,120 +327,238 @@ CONFIG_SCHEMA = cv.Schema(
         cv.Optional(CONF_VERSION, default="1.0.0"): cv.string,
         cv.Optional(CONF_MAX_POWER, default=9000): cv.int_range(min=1, max=65535),
         cv.Optional(CONF_UPDATE_INTERVAL, default="1s"): cv.update_interval,
+        cv.Optional(CONF_MAX_CLIENTS, default=4): cv.int_range(min=1, max=8),
+        cv.Optional(CONF_CLIENT_TIMEOUT, default="30s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_EVENT_DRIVEN, default=False): cv.boolean,
+        cv.Optional(CONF_DEDICATED_TASK, default=False): cv.boolean,
+        cv.Optional(CONF_TASK_CORE, default=1): cv.int_range(min=0, max=1),
+        # Host test builds: abort on any heap allocation while serving requests or updating registers
+        cv.Optional(CONF_ALLOCATION_CHECK, default=False): cv.boolean,
+        # Optional SunSpec models (1, 103 and 123 are always served)
+        cv.Optional(CONF_MODEL_120, default=True): cv.boolean,
+        cv.Optional(CONF_MODEL_160, default=True): cv.boolean,
         # Source sensors (input from external components like modbus_controller)
-        cv.Optional(CONF_SOURCE_AC_POWER): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_VOLTAGE_A): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_VOLTAGE_B): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_VOLTAGE_C): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_CURRENT_A): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_CURRENT_B): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_CURRENT_C): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_FREQUENCY): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_POWER_FACTOR): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_TOTAL_ENERGY): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_DC_VOLTAGE): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_DC_CURRENT): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_DC_POWER): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_TEMPERATURE): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_PV2_VOLTAGE): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_PV2_CURRENT): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_PV2_POWER): cv.use_id(sensor.Sensor),
-        cv.Optional(CONF_SOURCE_INVERTER_STATUS): cv.use_id(sensor.Sensor),
+        **{cv.Optional(key): cv.use_id(sensor.Sensor) for key in SOURCE_FIELDS},
+        # Serve a source that stops publishing as unavailable (0 = keep its last value)
+        cv.Optional(CONF_STALE_TIMEOUT, default="0s"): cv.positive_time_period_milliseconds,
+        # Update source components on client demand instead of their own update_interval
+        cv.Optional(CONF_POLLING): cv.ensure_list(POLLER_SCHEMA),
         # Output sensor configurations (publish to Home Assistant)
-        cv.Optional(CONF_AC_POWER): sensor.sensor_schema(
+        cv.Optional(CONF_AC_POWER): output_sensor_schema(
             unit_of_measurement=UNIT_WATT,
             accuracy_decimals=0,
             device_class=DEVICE_CLASS_POWER,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_VOLTAGE_A): sensor.sensor_schema(
+        cv.Optional(CONF_AC_VOLTAGE_A): output_sensor_schema(
             unit_of_measurement=UNIT_VOLT,
             accuracy_decimals=1,
             device_class=DEVICE_CLASS_VOLTAGE,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_VOLTAGE_B): sensor.sensor_schema(
+        cv.Optional(CONF_AC_VOLTAGE_B): output_sensor_schema(
             unit_of_measurement=UNIT_VOLT,
             accuracy_decimals=1,
             device_class=DEVICE_CLASS_VOLTAGE,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_VOLTAGE_C): sensor.sensor_schema(
+        cv.Optional(CONF_AC_VOLTAGE_C): output_sensor_schema(
             unit_of_measurement=UNIT_VOLT,
             accuracy_decimals=1,
             device_class=DEVICE_CLASS_VOLTAGE,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_CURRENT_A): sensor.sensor_schema(
+        cv.Optional(CONF_AC_CURRENT_A): output_sensor_schema(
             unit_of_measurement=UNIT_AMPERE,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_CURRENT,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_CURRENT_B): sensor.sensor_schema(
+        cv.Optional(CONF_AC_CURRENT_B): output_sensor_schema(
             unit_of_measurement=UNIT_AMPERE,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_CURRENT,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_CURRENT_C): sensor.sensor_schema(
+        cv.Optional(CONF_AC_CURRENT_C): output_sensor_schema(
             unit_of_measurement=UNIT_AMPERE,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_CURRENT,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_AC_CURRENT_TOTAL): sensor.sensor_schema(
+        cv.Optional(CONF_AC_CURRENT_TOTAL): output_sensor_schema(
             unit_of_measurement=UNIT_AMPERE,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_CURRENT,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_FREQUENCY): sensor.sensor_schema(
+        cv.Optional(CONF_FREQUENCY): output_sensor_schema(
             unit_of_measurement=UNIT_HERTZ,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_FREQUENCY,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_POWER_FACTOR): sensor.sensor_schema(
+        cv.Optional(CONF_POWER_FACTOR): output_sensor_schema(
             accuracy_decimals=2,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_TOTAL_ENERGY): sensor.sensor_schema(
+        cv.Optional(CONF_TOTAL_ENERGY): output_sensor_schema(
             unit_of_measurement=UNIT_WATT_HOURS,
             accuracy_decimals=0,
             device_class=DEVICE_CLASS_ENERGY,
             state_class=STATE_CLASS_TOTAL_INCREASING,
         ),
-        cv.Optional(CONF_DC_VOLTAGE): sensor.sensor_schema(
+        cv.Optional(CONF_DC_VOLTAGE): output_sensor_schema(
             unit_of_measurement=UNIT_VOLT,
             accuracy_decimals=1,
             device_class=DEVICE_CLASS_VOLTAGE,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_DC_CURRENT): sensor.sensor_schema(
+        cv.Optional(CONF_DC_CURRENT): output_sensor_schema(
             unit_of_measurement=UNIT_AMPERE,
             accuracy_decimals=2,
             device_class=DEVICE_CLASS_CURRENT,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_DC_POWER): sensor.sensor_schema(
+        cv.Optional(CONF_DC_POWER): output_sensor_schema(
             unit_of_measurement=UNIT_WATT,
             accuracy_decimals=0,
             device_class=DEVICE_CLASS_POWER,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
-        cv.Optional(CONF_TEMPERATURE): sensor.sensor_schema(
+        cv.Optional(CONF_TEMPERATURE): output_sensor_schema(
             unit_of_measurement=UNIT_CELSIUS,
             accuracy_decimals=0,
             device_class=DEVICE_CLASS_TEMPERATURE,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
+        cv.Optional(CONF_SUPPRESSED_PUBLISHES): sensor.sensor_schema(
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        # Server counters (also readable over Modbus in the diagnostic register block)
+        cv.Optional(CONF_DIAGNOSTICS): DIAGNOSTICS_SCHEMA,
+        # Latency histograms (p50/p99/max per window)
+        cv.Optional(CONF_LATENCY): LATENCY_SCHEMA,
+        # Delta-encoded sample history, readable after the diagnostic block
+        cv.Optional(CONF_HISTORY): HISTORY_SCHEMA,
         # Power limit number (target for Growatt active power rate via Model 123)
         cv.Optional(CONF_TARGET_POWER_LIMIT): cv.use_id(number.Number),
+        cv.Optional(CONF_POWER_LIMIT_DEADBAND, default=0.0): cv.float_range(min=0.0, max=100.0),
+        cv.Optional(CONF_POWER_LIMIT_INTERVAL, default="1s"): cv.positive_time_period_milliseconds,
+        # Regulate the measured AC power onto the limit instead of passing the rate through
+        cv.Optional(CONF_CLOSED_LOOP): CLOSED_LOOP_SCHEMA,
+        # Keep the Model 123 limit and the energy count across reboots (ESPHome preferences)
+        cv.Optional(CONF_RESTORE_STATE, default=True): cv.boolean,
+        cv.Optional(CONF_PERSIST_INTERVAL, default="10min"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(seconds=10))
+        ),
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
 
+# Options of the TCP server itself; only the instance that owns the server takes them
+SERVER_OPTIONS = (
+    CONF_PORT,
+    CONF_MAX_CLIENTS,
+    CONF_CLIENT_TIMEOUT,
+    CONF_DEDICATED_TASK,
+    CONF_TASK_CORE,
+    CONF_ALLOCATION_CHECK,
+    CONF_MODEL_120,
+    CONF_MODEL_160,
+    CONF_DIAGNOSTICS,
+    CONF_LATENCY,
+)
+
+
+def _validate_server_options(config):
+    # Runs before the schema so defaults don't count as set
+    if isinstance(config, dict) and CONF_SERVER_ID in config:
+        for key in SERVER_OPTIONS:
+            if key in config:
+                raise cv.Invalid(f"{key} belongs on the instance referenced by {CONF_SERVER_ID}")
+    return config
+
+
+def _validate_models(config):
+    # PV2 is only exposed as Model 160 tracker 1
+    if CONF_SERVER_ID not in config and not config[CONF_MODEL_160]:
+        for key in (CONF_SOURCE_PV2_VOLTAGE, CONF_SOURCE_PV2_CURRENT, CONF_SOURCE_PV2_POWER):
+            if key in config:
+                raise cv.Invalid(f"{key} requires {CONF_MODEL_160}: true")
+    return config
+
+
+def _validate_polling(config):
+    for poller in config.get(CONF_POLLING, []):
+        if poller[CONF_IDLE_INTERVAL] < poller[CONF_INTERVAL]:
+            raise cv.Invalid(f"{CONF_IDLE_INTERVAL} must not be shorter than {CONF_INTERVAL}")
+        for key in poller.get(CONF_SOURCES, []):
+            if key not in config:
+                raise cv.Invalid(f"{CONF_POLLING} lists {key}, which is not configured")
+        # An idle source is still polled once per idle_interval; it must not expire in between
+        stale_timeout = config[CONF_STALE_TIMEOUT].total_milliseconds
+        if stale_timeout and stale_timeout <= poller[CONF_IDLE_INTERVAL].total_milliseconds:
+            raise cv.Invalid(f"{CONF_STALE_TIMEOUT} must be longer than every {CONF_IDLE_INTERVAL}")
+    return config
+
+
+def _validate_closed_loop(config):
+    if CONF_CLOSED_LOOP in config:
+        for key in (CONF_TARGET_POWER_LIMIT, CONF_SOURCE_AC_POWER):
+            if key not in config:
+                raise cv.Invalid(f"{CONF_CLOSED_LOOP} requires {key}")
+    return config
+
+
+def _validate_dedicated_task(config):
+    # The server task needs FreeRTOS (ESP32) or std::thread (Linux host)
+    if CONF_SERVER_ID not in config and config[CONF_DEDICATED_TASK] and not (CORE.is_esp32 or CORE.is_host):
+        raise cv.Invalid(f"{CONF_DEDICATED_TASK} is only supported on ESP32 and the host platform")
+    return config
+
+
+def _validate_allocation_check(config):
+    # Replaces the global operator new; not something to ship to a device
+    if config[CONF_ALLOCATION_CHECK] and not CORE.is_host:
+        raise cv.Invalid(f"{CONF_ALLOCATION_CHECK} is only supported on the host platform")
+    return config
+
+
+CONFIG_SCHEMA = cv.All(
+    _validate_server_options,
+    CONFIG_SCHEMA,
+    _validate_models,
+    _validate_polling,
+    _validate_closed_loop,
+    _validate_dedicated_task,
+    _validate_allocation_check,
+)
+
+
+def _final_validate(config):
+    if CONF_SERVER_ID not in config:
+        return config
+    instances = fv.full_config.get()["sunspec_modbus_server"]
+    server = next(conf for conf in instances if conf[CONF_ID] == config[CONF_SERVER_ID])
+    if CONF_SERVER_ID in server:
+        raise cv.Invalid(f"{CONF_SERVER_ID} must reference an instance that owns its server")
+    for key in (CONF_SOURCE_PV2_VOLTAGE, CONF_SOURCE_PV2_CURRENT, CONF_SOURCE_PV2_POWER):
+        if key in config and not server[CONF_MODEL_160]:
+            raise cv.Invalid(f"{key} requires {CONF_MODEL_160}: true on {server[CONF_ID]}")
+    shared = [conf for conf in instances if conf is server or conf.get(CONF_SERVER_ID) == server[CONF_ID]]
+    if len(shared) > 8:
+        raise cv.Invalid("A server can host at most 8 devices")
+    if sum(conf[CONF_UNIT_ID] == config[CONF_UNIT_ID] for conf in shared) > 1:
+        raise cv.Invalid(f"{CONF_UNIT_ID} {config[CONF_UNIT_ID]} is already served by {server[CONF_ID]}")
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
@@ -211,7 +568,6 @@ async def to_code(config):
     elif CORE.is_esp8266:
         cg.add_library("ESP8266WiFi", None)
 
-    cg.add(var.set_port(config[CONF_PORT]))
     cg.add(var.set_unit_id(config[CONF_UNIT_ID]))
     cg.add(var.set_manufacturer(config[CONF_MANUFACTURER]))
     cg.add(var.set_model(config[CONF_MODEL]))
@@ -219,141 +575,93 @@ async def to_code(config):
     cg.add(var.set_version(config[CONF_VERSION]))
     cg.add(var.set_max_power(config[CONF_MAX_POWER]))
     cg.add(var.set_update_interval(config[CONF_UPDATE_INTERVAL]))
-
-    # Register source sensors (input from external components)
-    if CONF_SOURCE_AC_POWER in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_AC_POWER])
-        cg.add(var.set_source_ac_power(sens))
-
-    if CONF_SOURCE_VOLTAGE_A in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_VOLTAGE_A])
-        cg.add(var.set_source_voltage_a(sens))
-
-    if CONF_SOURCE_VOLTAGE_B in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_VOLTAGE_B])
-        cg.add(var.set_source_voltage_b(sens))
-
-    if CONF_SOURCE_VOLTAGE_C in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_VOLTAGE_C])
-        cg.add(var.set_source_voltage_c(sens))
-
-    if CONF_SOURCE_CURRENT_A in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_CURRENT_A])
-        cg.add(var.set_source_current_a(sens))
-
-    if CONF_SOURCE_CURRENT_B in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_CURRENT_B])
-        cg.add(var.set_source_current_b(sens))
-
-    if CONF_SOURCE_CURRENT_C in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_CURRENT_C])
-        cg.add(var.set_source_current_c(sens))
-
-    if CONF_SOURCE_FREQUENCY in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_FREQUENCY])
-        cg.add(var.set_source_frequency(sens))
-
-    if CONF_SOURCE_POWER_FACTOR in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_POWER_FACTOR])
-        cg.add(var.set_source_power_factor(sens))
-
-    if CONF_SOURCE_TOTAL_ENERGY in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_TOTAL_ENERGY])
-        cg.add(var.set_source_total_energy(sens))
-
-    if CONF_SOURCE_DC_VOLTAGE in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_DC_VOLTAGE])
-        cg.add(var.set_source_dc_voltage(sens))
-
-    if CONF_SOURCE_DC_CURRENT in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_DC_CURRENT])
-        cg.add(var.set_source_dc_current(sens))
-
-    if CONF_SOURCE_DC_POWER in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_DC_POWER])
-        cg.add(var.set_source_dc_power(sens))
-
-    if CONF_SOURCE_TEMPERATURE in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_TEMPERATURE])
-        cg.add(var.set_source_temperature(sens))
-
-    if CONF_SOURCE_PV2_VOLTAGE in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_PV2_VOLTAGE])
-        cg.add(var.set_source_pv2_voltage(sens))
-
-    if CONF_SOURCE_PV2_CURRENT in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_PV2_CURRENT])
-        cg.add(var.set_source_pv2_current(sens))
-
-    if CONF_SOURCE_PV2_POWER in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_PV2_POWER])
-        cg.add(var.set_source_pv2_power(sens))
-
-    if CONF_SOURCE_INVERTER_STATUS in config:
-        sens = await cg.get_variable(config[CONF_SOURCE_INVERTER_STATUS])
-        cg.add(var.set_source_inverter_status(sens))
-
-    # Register output sensors (publish to Home Assistant)
-    if CONF_AC_POWER in config:
-        sens = await sensor.new_sensor(config[CONF_AC_POWER])
-        cg.add(var.set_ac_power_sensor(sens))
-
-    if CONF_AC_VOLTAGE_A in config:
-        sens = await sensor.new_sensor(config[CONF_AC_VOLTAGE_A])
-        cg.add(var.set_ac_voltage_a_sensor(sens))
-
-    if CONF_AC_VOLTAGE_B in config:
-        sens = await sensor.new_sensor(config[CONF_AC_VOLTAGE_B])
-        cg.add(var.set_ac_voltage_b_sensor(sens))
-
-    if CONF_AC_VOLTAGE_C in config:
-        sens = await sensor.new_sensor(config[CONF_AC_VOLTAGE_C])
-        cg.add(var.set_ac_voltage_c_sensor(sens))
-
-    if CONF_AC_CURRENT_A in config:
-        sens = await sensor.new_sensor(config[CONF_AC_CURRENT_A])
-        cg.add(var.set_ac_current_a_sensor(sens))
-
-    if CONF_AC_CURRENT_B in config:
-        sens = await sensor.new_sensor(config[CONF_AC_CURRENT_B])
-        cg.add(var.set_ac_current_b_sensor(sens))
-
-    if CONF_AC_CURRENT_C in config:
-        sens = await sensor.new_sensor(config[CONF_AC_CURRENT_C])
-        cg.add(var.set_ac_current_c_sensor(sens))
-
-    if CONF_AC_CURRENT_TOTAL in config:
-        sens = await sensor.new_sensor(config[CONF_AC_CURRENT_TOTAL])
-        cg.add(var.set_ac_current_total_sensor(sens))
-
-    if CONF_FREQUENCY in config:
-        sens = await sensor.new_sensor(config[CONF_FREQUENCY])
-        cg.add(var.set_frequency_sensor(sens))
-
-    if CONF_POWER_FACTOR in config:
-        sens = await sensor.new_sensor(config[CONF_POWER_FACTOR])
-        cg.add(var.set_power_factor_sensor(sens))
-
-    if CONF_TOTAL_ENERGY in config:
-        sens = await sensor.new_sensor(config[CONF_TOTAL_ENERGY])
-        cg.add(var.set_total_energy_sensor(sens))
-
-    if CONF_DC_VOLTAGE in config:
-        sens = await sensor.new_sensor(config[CONF_DC_VOLTAGE])
-        cg.add(var.set_dc_voltage_sensor(sens))
-
-    if CONF_DC_CURRENT in config:
-        sens = await sensor.new_sensor(config[CONF_DC_CURRENT])
-        cg.add(var.set_dc_current_sensor(sens))
-
-    if CONF_DC_POWER in config:
-        sens = await sensor.new_sensor(config[CONF_DC_POWER])
-        cg.add(var.set_dc_power_sensor(sens))
-
-    if CONF_TEMPERATURE in config:
-        sens = await sensor.new_sensor(config[CONF_TEMPERATURE])
-        cg.add(var.set_temperature_sensor(sens))
+    cg.add(var.set_event_driven(config[CONF_EVENT_DRIVEN]))
+    cg.add(var.set_restore_state(config[CONF_RESTORE_STATE]))
+    cg.add(var.set_persist_interval(config[CONF_PERSIST_INTERVAL]))
+
+    if CONF_SERVER_ID in config:
+        server = await cg.get_variable(config[CONF_SERVER_ID])
+        cg.add(server.add_device(var))
+    else:
+        cg.add(var.set_port(config[CONF_PORT]))
+        cg.add(var.set_max_clients(config[CONF_MAX_CLIENTS]))
+        cg.add(var.set_client_timeout(config[CONF_CLIENT_TIMEOUT]))
+        cg.add(var.set_dedicated_task(config[CONF_DEDICATED_TASK]))
+        cg.add(var.set_task_core(config[CONF_TASK_CORE]))
+        if config[CONF_ALLOCATION_CHECK]:
+            cg.add_build_flag("-DSUNSPEC_ALLOCATION_CHECK")
+
+        # The register layout is computed at compile time from the enabled models
+        if not config[CONF_MODEL_120]:
+            cg.add_build_flag("-DSUNSPEC_MODEL_120=0")
+        if not config[CONF_MODEL_160]:
+            cg.add_build_flag("-DSUNSPEC_MODEL_160=0")
+
+    # Source sensors (input from external components) and output sensors (publish to
+    # Home Assistant); the component only stores the ones that are configured
+    for key, field in SOURCE_FIELDS.items():
+        if key in config:
+            sens = await cg.get_variable(config[key])
+            cg.add(var.add_source(field, sens))
+    cg.add(var.set_stale_timeout(config[CONF_STALE_TIMEOUT]))
+
+    for poller in config.get(CONF_POLLING, []):
+        comp = await cg.get_variable(poller[CONF_COMPONENT])
+        keys = poller.get(CONF_SOURCES, [key for key in SOURCE_FIELDS if key in config])
+        fields = [SOURCE_FIELDS[key] for key in keys]
+        cg.add(var.add_poller(comp, poller[CONF_INTERVAL], poller[CONF_IDLE_INTERVAL], fields))
+
+    for key, field in OUTPUT_FIELDS.items():
+        if key in config:
+            conf = config[key]
+            sens = await sensor.new_sensor(conf)
+            change_only = conf.get(CONF_CHANGE_ONLY, CONF_DEADBAND in conf or CONF_HEARTBEAT in conf)
+            cg.add(
+                var.add_output(
+                    field, sens, change_only, conf.get(CONF_DEADBAND, 0.0), conf.get(CONF_HEARTBEAT, 0)
+                )
+            )
+
+    if CONF_SUPPRESSED_PUBLISHES in config:
+        sens = await sensor.new_sensor(config[CONF_SUPPRESSED_PUBLISHES])
+        cg.add(var.set_suppressed_publishes_sensor(sens))
+
+    for key, counter in DIAGNOSTIC_COUNTERS.items():
+        if key in config.get(CONF_DIAGNOSTICS, {}):
+            sens = await sensor.new_sensor(config[CONF_DIAGNOSTICS][key])
+            cg.add(var.set_counter_sensor(counter, sens))
+    if CONF_HEAP_FREE in config.get(CONF_DIAGNOSTICS, {}):
+        sens = await sensor.new_sensor(config[CONF_DIAGNOSTICS][CONF_HEAP_FREE])
+        cg.add(var.set_heap_free_sensor(sens))
+    if CONF_HEAP_LARGEST_BLOCK in config.get(CONF_DIAGNOSTICS, {}):
+        sens = await sensor.new_sensor(config[CONF_DIAGNOSTICS][CONF_HEAP_LARGEST_BLOCK])
+        cg.add(var.set_heap_largest_block_sensor(sens))
+
+    if CONF_LATENCY in config:
+        latency = config[CONF_LATENCY]
+        cg.add(var.set_latency_interval(latency[CONF_INTERVAL]))
+        cg.add(var.set_control_tolerance(latency[CONF_CONTROL_TOLERANCE]))
+        for key, metric in LATENCY_METRICS.items():
+            for stat_key, stat in LATENCY_STATS.items():
+                if stat_key in latency.get(key, {}):
+                    sens = await sensor.new_sensor(latency[key][stat_key])
+                    cg.add(var.set_latency_sensor(metric, stat, sens))
+
+    if CONF_HISTORY in config:
+        history = config[CONF_HISTORY]
+        cg.add(var.set_history(history[CONF_SIZE], history[CONF_INTERVAL]))
 
     if CONF_TARGET_POWER_LIMIT in config:
         num = await cg.get_variable(config[CONF_TARGET_POWER_LIMIT])
         cg.add(var.set_power_limit_number(num))
+    cg.add(var.set_power_limit_deadband(config[CONF_POWER_LIMIT_DEADBAND]))
+    cg.add(var.set_power_limit_interval(config[CONF_POWER_LIMIT_INTERVAL]))
+    if CONF_CLOSED_LOOP in config:
+        closed_loop = config[CONF_CLOSED_LOOP]
+        cg.add(
+            var.set_closed_loop(
+                closed_loop[CONF_BANDWIDTH],
+                closed_loop[CONF_RESPONSE_TIME].total_milliseconds / 1000.0,
+                closed_loop[CONF_PROPORTIONAL_GAIN],
+            )
+        )
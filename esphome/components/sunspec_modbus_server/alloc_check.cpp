@@ -0,0 +1,52 @@
+#include "alloc_check.h"
+
+#ifdef SUNSPEC_ALLOCATION_CHECK
+
+#include "esphome/core/log.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static const char *const TAG = "sunspec_modbus_server.alloc";
+
+// Per thread: the server task and the main loop are checked independently
+static thread_local uint32_t allocations = 0;
+
+uint32_t thread_allocations() { return allocations; }
+
+AllocationCheck::~AllocationCheck() {
+  uint32_t count = allocations - this->start_;
+  if (count == 0)
+    return;
+  ESP_LOGE(TAG, "%u heap allocation(s) in %s", count, this->what_);
+  abort();
+}
+
+static void *counted_alloc(size_t size) {
+  allocations++;
+  return malloc(size == 0 ? 1 : size);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+using esphome::sunspec_modbus_server::counted_alloc;
+
+void *operator new(size_t size) {
+  void *ptr = counted_alloc(size);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return counted_alloc(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return counted_alloc(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+#endif  // SUNSPEC_ALLOCATION_CHECK
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Steady-state allocation check for host test builds (allocation_check: true sets
+// SUNSPEC_ALLOCATION_CHECK). operator new is replaced with a per-thread counter, and
+// an AllocationCheck scope aborts the process if anything inside it allocated, so a
+// load run against the host build fails on the first request that touches the heap.
+// In every other build the scope is empty.
+#ifdef SUNSPEC_ALLOCATION_CHECK
+
+// operator new calls made by the calling thread so far
+uint32_t thread_allocations();
+
+class AllocationCheck {
+ public:
+  explicit AllocationCheck(const char *what) : what_(what), start_(thread_allocations()) {}
+  ~AllocationCheck();
+
+ protected:
+  const char *what_;
+  uint32_t start_;
+};
+
+#else
+
+class AllocationCheck {
+ public:
+  explicit AllocationCheck(const char *what) {}
+};
+
+#endif  // SUNSPEC_ALLOCATION_CHECK
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Fixed-bucket latency histogram in microseconds; no allocation, ~200 bytes.
+//
+// Buckets are half-octaves: 0, 1, 2, 3, 4-5, 6-7, 8-11, 12-15, ... so every
+// recorded value is reported with at most ~33% error, up to RANGE_US (2^26 us,
+// ~67 s, enough for the slowest control trace). Larger values land in the last
+// bucket; max() is always exact.
+class LatencyHistogram {
+ public:
+  static const uint8_t RANGE_BITS = 26;
+  static const uint32_t RANGE_US = 1UL << RANGE_BITS;
+  static const uint8_t BUCKETS = RANGE_BITS * 2;
+
+  void record(uint32_t us) {
+    uint8_t bucket = bucket_of(us);
+    this->buckets_[bucket]++;
+    this->count_++;
+    if (us > this->max_)
+      this->max_ = us;
+  }
+
+  // Upper bound of the bucket holding the pct-th percentile (0 when empty)
+  uint32_t percentile(uint8_t pct) const {
+    if (this->count_ == 0)
+      return 0;
+    uint32_t target = (uint32_t) (((uint64_t) this->count_ * pct + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < BUCKETS; i++) {
+      seen += this->buckets_[i];
+      if (seen >= target) {
+        uint32_t upper = upper_bound_of(i);
+        return upper < this->max_ ? upper : this->max_;
+      }
+    }
+    return this->max_;
+  }
+
+  uint32_t count() const { return this->count_; }
+  uint32_t max() const { return this->max_; }
+
+  void reset() {
+    memset(this->buckets_, 0, sizeof(this->buckets_));
+    this->count_ = 0;
+    this->max_ = 0;
+  }
+
+ protected:
+  static uint8_t bucket_of(uint32_t us) {
+    if (us < 2)
+      return us;
+    if (us >= RANGE_US)
+      return BUCKETS - 1;
+    uint8_t octave = 31 - __builtin_clz(us);  // us >= 2, so octave >= 1
+    uint8_t half = (us >> (octave - 1)) & 1;
+    return octave * 2 + half;
+  }
+
+  static uint32_t upper_bound_of(uint8_t bucket) {
+    if (bucket < 2)
+      return bucket;
+    uint8_t octave = bucket / 2;
+    uint32_t lower = (2UL + (bucket & 1)) << (octave - 1);
+    return lower + (1UL << (octave - 1)) - 1;
+  }
+
+  // Same width as count_, so the bucket sum always equals count_ and percentile() stays
+  // exact however long a window runs
+  uint32_t buckets_[BUCKETS]{};
+  uint32_t count_{0};
+  uint32_t max_{0};
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,125 @@
+#include "history.h"
+#include "register_image.h"
+#include "esphome/core/hal.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static inline void put_u16(uint8_t *dest, uint16_t value) {
+  dest[0] = value >> 8;
+  dest[1] = value & 0xFF;
+}
+
+static inline void put_u32(uint8_t *dest, uint32_t value) {
+  put_u16(dest, value >> 16);
+  put_u16(dest + 2, value & 0xFFFF);
+}
+
+// Signed delta → unsigned varint, small magnitudes in few bytes (1 byte for -64…63)
+static uint8_t put_zigzag(uint8_t *dest, int32_t delta) {
+  uint32_t value = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+  uint8_t len = 0;
+  while (value >= 0x80) {
+    dest[len++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  dest[len++] = value;
+  return len;
+}
+
+void HistoryBuffer::init(size_t size, uint32_t interval_ms) {
+  size_t blocks = size / BLOCK_SIZE;
+  if (blocks < 2)
+    blocks = 2;
+  this->block_count_ = blocks;
+  this->interval_ms_ = interval_ms;
+  this->bytes_.reset(new uint8_t[blocks * BLOCK_SIZE]());
+  for (uint16_t i = 0; i < this->block_count_; i++)
+    put_u16(this->block_(i), BLOCK_HEADER_SIZE);  // empty, first sequence number 0
+}
+
+void HistoryBuffer::start_block_(uint16_t index) {
+  uint8_t *block = this->block_(index);
+  put_u16(block, BLOCK_HEADER_SIZE);
+  put_u32(block + 2, this->sequence_number_);
+  this->previous_ = HistorySample{};
+}
+
+void HistoryBuffer::append(HistorySample sample, uint32_t now_ms) {
+  if (!this->is_enabled())
+    return;
+
+  // Wrap-free seconds clock: millis() deltas between samples, remainder carried
+  if (this->sequence_number_ > 0) {
+    uint32_t elapsed = now_ms - this->last_ms_ + this->carry_ms_;
+    this->clock_s_ += elapsed / 1000;
+    this->carry_ms_ = elapsed % 1000;
+  }
+  sample.values[HISTORY_TIME] = this->clock_s_;
+
+  this->seqlock_.store(this->seqlock_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  this->last_ms_ = now_ms;
+  this->sequence_number_++;
+  uint8_t *block = this->block_(this->current_);
+  uint16_t used = (block[0] << 8) | block[1];
+  if (this->sequence_number_ == 1) {
+    this->start_block_(this->current_);
+    used = BLOCK_HEADER_SIZE;
+  } else if (used + MAX_RECORD_SIZE > BLOCK_SIZE) {
+    // Next block; in a full ring this drops the oldest one
+    this->current_ = (this->current_ + 1) % this->block_count_;
+    this->start_block_(this->current_);
+    block = this->block_(this->current_);
+    used = BLOCK_HEADER_SIZE;
+  }
+  for (uint8_t field = 0; field < HISTORY_FIELD_COUNT; field++) {
+    // Wrapping difference: the decoder adds it back modulo 2^32
+    int32_t delta = (int32_t) ((uint32_t) sample.values[field] - (uint32_t) this->previous_.values[field]);
+    used += put_zigzag(block + used, delta);
+  }
+  put_u16(block, used);
+  this->previous_ = sample;
+
+  this->seqlock_.store(this->seqlock_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void HistoryBuffer::copy_registers_(uint16_t first, uint16_t count, uint8_t *dest) const {
+  uint8_t header[HEADER_REGISTERS * 2];
+  put_u32(header, this->sequence_number_);
+  put_u16(header + 4, this->block_count_);
+  put_u16(header + 6, BLOCK_SIZE / 2);
+  put_u16(header + 8, this->current_);
+  put_u16(header + 10, this->interval_ms_ / 1000);
+  put_u32(header + 12, this->sequence_number_ > 0 ? (millis() - this->last_ms_) / 1000 : 0);
+
+  if (first < HEADER_REGISTERS) {
+    uint16_t n = count < HEADER_REGISTERS - first ? count : HEADER_REGISTERS - first;
+    memcpy(dest, header + first * 2, n * 2);
+    dest += n * 2;
+    first += n;
+    count -= n;
+  }
+  if (count > 0)
+    memcpy(dest, &this->bytes_[(first - HEADER_REGISTERS) * 2], count * 2);
+}
+
+void HistoryBuffer::read_registers(uint16_t first, uint16_t count, uint8_t *dest) const {
+  uint8_t spins = 0;
+  while (true) {
+    uint32_t before = this->seqlock_.load(std::memory_order_acquire);
+    if ((before & 1) == 0) {
+      this->copy_registers_(first, count, dest);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (this->seqlock_.load(std::memory_order_relaxed) == before)
+        return;
+    }
+    seqlock_backoff(spins);
+  }
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Sampled values, in register units
+enum HistoryField : uint8_t {
+  HISTORY_TIME,         // seconds since the first sample (filled in by HistoryBuffer)
+  HISTORY_AC_POWER,     // W
+  HISTORY_ENERGY,       // Wh
+  HISTORY_DC_VOLTAGE_1, // 0.1 V, tracker 0
+  HISTORY_DC_CURRENT_1, // 0.01 A, tracker 0
+  HISTORY_DC_VOLTAGE_2, // 0.1 V, tracker 1
+  HISTORY_DC_CURRENT_2, // 0.01 A, tracker 1
+  HISTORY_TEMPERATURE,  // °C
+  HISTORY_STATE,        // Model 103 St
+  HISTORY_FIELD_COUNT,
+};
+
+struct HistorySample {
+  int32_t values[HISTORY_FIELD_COUNT]{};
+};
+
+// Fixed-size history of samples, readable as a register window.
+//
+// The buffer is a ring of BLOCK_SIZE byte blocks. Each block starts with
+// its used length (uint16) and the sequence number of its first sample (uint32),
+// followed by samples as zigzag varint deltas per field; the first sample of a
+// block is a delta from zero, so every block decodes on its own. When the ring is
+// full the oldest block is dropped as a whole.
+//
+// Register window (read-only, big-endian):
+//   0-1  sequence number of the newest sample (0 = empty)
+//   2    block count          3  block size in registers
+//   4    index of the block being appended
+//   5    sample interval (s)  6-7  seconds since the newest sample
+//   8…   the blocks, BLOCK_SIZE / 2 registers each
+//
+// One writer (the main loop); readers on any task get a consistent copy through a
+// seqlock, as with RegisterImage.
+class HistoryBuffer {
+ public:
+  static const uint16_t HEADER_REGISTERS = 8;
+  static const uint16_t BLOCK_SIZE = 128;  // bytes
+
+  // size is rounded down to whole blocks (at least two)
+  void init(size_t size, uint32_t interval_ms);
+  bool is_enabled() const { return this->block_count_ > 0; }
+  uint32_t get_interval() const { return this->interval_ms_; }
+  size_t get_size() const { return (size_t) this->block_count_ * BLOCK_SIZE; }
+
+  void append(HistorySample sample, uint32_t now_ms);
+
+  uint16_t window_registers() const { return HEADER_REGISTERS + this->block_count_ * (BLOCK_SIZE / 2); }
+  // Copy count registers starting at first (window-relative) in wire order
+  void read_registers(uint16_t first, uint16_t count, uint8_t *dest) const;
+
+ protected:
+  static const uint8_t BLOCK_HEADER_SIZE = 6;
+  static const uint8_t MAX_RECORD_SIZE = HISTORY_FIELD_COUNT * 5;  // 5 bytes per 32-bit varint
+
+  uint8_t *block_(uint16_t index) const { return &this->bytes_[(size_t) index * BLOCK_SIZE]; }
+  void start_block_(uint16_t index);
+  void copy_registers_(uint16_t first, uint16_t count, uint8_t *dest) const;
+
+  std::unique_ptr<uint8_t[]> bytes_;
+  uint16_t block_count_{0};
+  uint16_t current_{0};
+  uint32_t interval_ms_{60000};
+
+  uint32_t sequence_number_{0};  // of the newest sample
+  HistorySample previous_;       // last sample of the current block (delta base)
+  uint32_t clock_s_{0};          // HISTORY_TIME of the newest sample
+  uint32_t carry_ms_{0};         // sub-second remainder of the clock
+  uint32_t last_ms_{0};          // millis() of the newest sample
+
+  std::atomic<uint32_t> seqlock_{0};  // odd while append() is modifying the buffer
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,650 @@
+#include "modbus_tcp_server.h"
+#include "sunspec_registers.h"
+#include "alloc_check.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static const char *const TAG = "sunspec_modbus_server";
+
+// Modbus function codes
+static const uint8_t FC_READ_HOLDING_REGISTERS = 0x03;
+static const uint8_t FC_READ_INPUT_REGISTERS = 0x04;
+static const uint8_t FC_WRITE_SINGLE_REGISTER = 0x06;
+static const uint8_t FC_WRITE_MULTIPLE_REGISTERS = 0x10;
+static const uint8_t FC_READ_WRITE_MULTIPLE_REGISTERS = 0x17;
+static const uint8_t FC_ENCAPSULATED_INTERFACE = 0x2B;
+static const uint8_t MEI_READ_DEVICE_ID = 0x0E;
+
+// Modbus exception codes
+static const uint8_t EX_ILLEGAL_FUNCTION = 0x01;
+static const uint8_t EX_ILLEGAL_DATA_ADDRESS = 0x02;
+static const uint8_t EX_ILLEGAL_DATA_VALUE = 0x03;
+
+// Modbus TCP header size (MBAP)
+static const size_t MBAP_HEADER_SIZE = 7;
+static const size_t READ_RESPONSE_HEADER_SIZE = MBAP_HEADER_SIZE + 2;  // + function code + byte count
+static const size_t MIN_REQUEST_SIZE = 12;  // MBAP + Unit ID + FC + Start Addr + Quantity
+static const size_t DEVICE_ID_REQUEST_SIZE = 11;  // MBAP + Unit ID + FC + MEI type + read code + object ID
+static const size_t MAX_ADU_SIZE = 260;     // MBAP (7) + PDU (253)
+static const size_t WRITE_MULTIPLE_HEADER_SIZE = 13;  // MIN_REQUEST_SIZE + byte count
+static const uint16_t MAX_WRITE_REGISTERS = 123;     // FC16 limit (246 data bytes in a 253-byte PDU)
+static const size_t READ_WRITE_MULTIPLE_HEADER_SIZE = 17;  // MBAP + FC + read/write start and quantity + byte count
+static const uint16_t MAX_READ_WRITE_REGISTERS = 121;      // FC23 write limit (242 data bytes)
+
+// FC43/14 objects, served from the Model 1 strings of the addressed device. All of
+// them fit one response, so "more follows" is never set.
+struct DeviceIdObject {
+  uint8_t id;
+  uint8_t offset;  // Model 1 register
+  uint8_t length;  // bytes
+};
+static const DeviceIdObject DEVICE_ID_OBJECTS[] = {
+    {0x00, Model1::Mn, 32},  // VendorName
+    {0x01, Model1::Md, 32},  // ProductCode
+    {0x02, Model1::Vr, 16},  // MajorMinorRevision
+    {0x05, Model1::Md, 32},  // ModelName
+    {0x80, Model1::SN, 32},  // serial number (first extended object)
+};
+static const uint8_t DEVICE_ID_CONFORMITY = 0x83;  // extended, stream and individual access
+static const uint16_t DEVICE_ID_STRINGS = Model1::SN + 16;  // Model 1 registers holding all the strings
+
+static_assert(TOTAL_REGISTERS <= DEMAND_CHUNK * DEMAND_CHUNKS, "read demand chunks must cover the register image");
+
+// Modbus address → register index; some clients use 0-based addressing
+static inline uint16_t register_index(uint16_t address) {
+  return address >= SUNSPEC_BASE_ADDRESS ? address - SUNSPEC_BASE_ADDRESS : address;
+}
+
+static_assert((RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1)) == 0, "RX_BUFFER_SIZE must be a power of two");
+static_assert(RX_BUFFER_SIZE >= MAX_ADU_SIZE, "RX_BUFFER_SIZE must hold a maximum size ADU");
+
+bool ModbusTcpServer::begin(uint16_t port) {
+  this->clients_.reset(new ClientSlot[this->max_clients_]);
+  return this->transport_->begin(port, this->max_clients_);
+}
+
+int ModbusTcpServer::add_device(uint8_t unit_id, RegisterImage *image, const HistoryBuffer *history) {
+  if (unit_id == 0 || this->device_count_ >= MAX_DEVICES || this->unit_devices_[unit_id] != 0)
+    return DEVICE_NONE;
+  uint8_t device = this->device_count_++;
+  this->images_[device] = image;
+  if (history != nullptr && history->is_enabled())
+    this->histories_[device] = history;
+  this->unit_devices_[unit_id] = device + 1;
+  if (device == 0)
+    this->unit_devices_[0] = 1;  // broadcast address → first device
+  return device;
+}
+
+void ModbusTcpServer::loop(uint32_t now) {
+  AllocationCheck check("Modbus server loop");
+  // Accept into free slots, then serve every connected slot once, rotating the
+  // starting slot each loop
+  this->transport_->poll();
+  this->accept_clients_(now);
+  for (uint8_t n = 0; n < this->max_clients_; n++) {
+    uint8_t index = (this->next_slot_ + n) % this->max_clients_;
+    if (this->clients_[index].connected)
+      this->handle_client_(index, now);
+  }
+  this->next_slot_ = (this->next_slot_ + 1) % this->max_clients_;
+}
+
+void ModbusTcpServer::accept_clients_(uint32_t now) {
+  while (true) {
+    int index = this->transport_->accept();
+    if (index == ACCEPT_NONE)
+      return;
+    if (index == ACCEPT_REJECTED) {
+      this->count_(COUNTER_REJECTS);
+      ESP_LOGW(TAG, "Rejected new client, all %u slots in use", this->max_clients_);
+      continue;
+    }
+
+    this->count_(COUNTER_ACCEPTS);
+    ClientSlot &slot = this->clients_[index];
+    slot.connected = true;
+    slot.connected_ms = now;
+    slot.last_rx_ms = now;
+    slot.rx_head = 0;
+    slot.rx_len = 0;
+    slot.requests = 0;
+    slot.bytes_in = 0;
+    slot.bytes_out = 0;
+
+    char address[24];
+    this->transport_->get_remote_address(index, address, sizeof(address));
+    ESP_LOGI(TAG, "Client connected from %s (slot %d)", address, index);
+  }
+}
+
+void ModbusTcpServer::close_client_(uint8_t index, uint32_t now, const char *reason) {
+  ClientSlot &slot = this->clients_[index];
+  ESP_LOGI(TAG, "Client in slot %u %s after %u s (%u requests, %u bytes in, %u bytes out)", index, reason,
+           (unsigned) ((now - slot.connected_ms) / 1000), (unsigned) slot.requests, (unsigned) slot.bytes_in,
+           (unsigned) slot.bytes_out);
+  this->transport_->close(index);
+  slot.connected = false;
+}
+
+void ModbusTcpServer::handle_client_(uint8_t index, uint32_t now) {
+  ClientSlot &slot = this->clients_[index];
+
+  // Stale connection timeout: force-close if no data received for client_timeout_
+  if ((now - slot.last_rx_ms) >= this->client_timeout_) {
+    ESP_LOGW(TAG, "Client timeout — forcing disconnect");
+    this->count_(COUNTER_TIMEOUTS);
+    this->close_client_(index, now, "timed out");
+    return;
+  }
+
+  // A peer that closed (or half-closed) after pipelining requests still has them
+  // applied; only the responses are skipped (see write_()). The slot is released
+  // once every complete frame is processed.
+  this->receive_(index, now);
+  if (!this->process_frames_(index)) {
+    this->count_(COUNTER_INVALID_FRAMES);
+    this->close_client_(index, now, "sent an invalid MBAP header");
+    return;
+  }
+  if (!this->transport_->connected(index))
+    this->close_client_(index, now, "disconnected");
+}
+
+void ModbusTcpServer::receive_(uint8_t index, uint32_t now) {
+  ClientSlot &slot = this->clients_[index];
+
+  // Drain whatever the socket has into the ring — at most two contiguous
+  // segments (up to the end of the buffer, then from the start after wrapping)
+  for (uint8_t segment = 0; segment < 2; segment++) {
+    uint16_t free_space = RX_BUFFER_SIZE - slot.rx_len;
+    if (free_space == 0)
+      return;
+    uint16_t tail = (slot.rx_head + slot.rx_len) & (RX_BUFFER_SIZE - 1);
+    uint16_t chunk = std::min<uint16_t>(free_space, RX_BUFFER_SIZE - tail);
+    int len = this->transport_->read(index, slot.rx_buf + tail, chunk);
+    if (len <= 0)
+      return;
+    slot.rx_len += len;
+    slot.bytes_in += len;
+    this->count_(COUNTER_BYTES_IN, len);
+    slot.last_rx_ms = now;
+    if (len < chunk)
+      return;
+  }
+}
+
+bool ModbusTcpServer::process_frames_(uint8_t index) {
+  ClientSlot &slot = this->clients_[index];
+
+  // Process every complete frame in the ring; a trailing partial frame stays
+  // buffered until the rest of it arrives
+  while (slot.rx_len >= MBAP_HEADER_SIZE) {
+    // MBAP length field (bytes 4-5) counts unit ID + PDU
+    uint16_t length = (slot.rx_buf[(slot.rx_head + 4) & (RX_BUFFER_SIZE - 1)] << 8) |
+                      slot.rx_buf[(slot.rx_head + 5) & (RX_BUFFER_SIZE - 1)];
+    size_t frame_len = 6 + length;
+    if (length < 2 || frame_len > MAX_ADU_SIZE) {
+      // No way to find the next frame boundary — the stream is unusable
+      ESP_LOGW(TAG, "Invalid MBAP length %u", length);
+      return false;
+    }
+    if (slot.rx_len < frame_len)
+      break;
+
+    // Linearize the frame (it may wrap around the end of the ring)
+    uint8_t frame[MAX_ADU_SIZE];
+    uint16_t first = std::min<uint16_t>(frame_len, RX_BUFFER_SIZE - slot.rx_head);
+    memcpy(frame, slot.rx_buf + slot.rx_head, first);
+    memcpy(frame + first, slot.rx_buf, frame_len - first);
+    slot.rx_head = (slot.rx_head + frame_len) & (RX_BUFFER_SIZE - 1);
+    slot.rx_len -= frame_len;
+
+    slot.requests++;
+    this->frame_start_us_ = micros();
+    this->process_request_(index, frame, frame_len);
+  }
+  return true;
+}
+
+void ModbusTcpServer::write_(uint8_t index, const uint8_t *data, size_t len) {
+  // Closed by the peer, or by the transport after a short send: nobody reads the response
+  if (!this->transport_->connected(index))
+    return;
+  size_t sent = this->transport_->write(index, data, len);
+  this->clients_[index].bytes_out += sent;
+  this->count_(COUNTER_BYTES_OUT, sent);
+  if (this->time_requests_ && this->listener_ != nullptr)
+    this->listener_->on_request_latency(micros() - this->frame_start_us_);
+}
+
+void ModbusTcpServer::process_request_(uint8_t index, uint8_t *buffer, size_t len) {
+  // Parse MBAP header
+  // uint16_t transaction_id = (buffer[0] << 8) | buffer[1];
+  uint16_t protocol_id = (buffer[2] << 8) | buffer[3];
+  // uint16_t length = (buffer[4] << 8) | buffer[5];
+  uint8_t unit_id = buffer[6];
+
+  // Modbus TCP protocol_id must always be 0x0000
+  if (protocol_id != 0) {
+    ESP_LOGW(TAG, "Ignoring non-Modbus frame (protocol_id=0x%04X)", protocol_id);
+    this->count_(COUNTER_DROPPED_PROTOCOL);
+    return;
+  }
+
+  ESP_LOGD(TAG, "Request: Unit=%u, FC=%u, %u bytes", unit_id, buffer[7], (unsigned) len);
+
+  // Route by unit ID
+  uint8_t device = this->unit_devices_[unit_id];
+  if (device == 0) {
+    // Ignore requests not for us (don't respond per Modbus spec)
+    ESP_LOGD(TAG, "Ignoring request for unit %u", unit_id);
+    this->count_(COUNTER_DROPPED_UNIT);
+    return;
+  }
+  device--;
+
+  // Framing guarantees at least MBAP + function code; every supported request
+  // also carries a 4-byte address/quantity (or address/value) field, except
+  // FC43, which carries three bytes. Checked only now, so a short frame that is
+  // not ours is dropped silently like any other.
+  uint8_t function_code = buffer[7];
+  if (len < (function_code == FC_ENCAPSULATED_INTERFACE ? DEVICE_ID_REQUEST_SIZE : MIN_REQUEST_SIZE)) {
+    ESP_LOGW(TAG, "Short request (%u bytes)", (unsigned) len);
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+    return;
+  }
+
+  // Handle function codes
+  switch (function_code) {
+    case FC_READ_HOLDING_REGISTERS:
+    case FC_READ_INPUT_REGISTERS: {
+      this->count_(function_code == FC_READ_HOLDING_REGISTERS ? COUNTER_READ_HOLDING : COUNTER_READ_INPUT);
+      uint16_t reg_start = register_index((buffer[8] << 8) | buffer[9]);
+      uint16_t quantity = (buffer[10] << 8) | buffer[11];
+
+      if (quantity == 0 || quantity > MAX_READ_REGISTERS) {
+        ESP_LOGW(TAG, "Invalid read quantity %u", quantity);
+        this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+        return;
+      }
+      if (!this->readable_(device, reg_start, quantity)) {
+        ESP_LOGW(TAG, "Invalid address range: %u + %u", reg_start, quantity);
+        this->send_error_(index, buffer, EX_ILLEGAL_DATA_ADDRESS);
+        return;
+      }
+      this->send_read_(index, buffer, device, reg_start, quantity);
+      break;
+    }
+    case FC_WRITE_SINGLE_REGISTER: {
+      this->count_(COUNTER_WRITE_SINGLE);
+      this->handle_write_single_(index, buffer, device);
+      break;
+    }
+    case FC_WRITE_MULTIPLE_REGISTERS: {
+      this->count_(COUNTER_WRITE_MULTIPLE);
+      this->handle_write_multiple_(index, buffer, len, device);
+      break;
+    }
+    case FC_READ_WRITE_MULTIPLE_REGISTERS: {
+      this->count_(COUNTER_READ_WRITE_MULTIPLE);
+      this->handle_read_write_multiple_(index, buffer, len, device);
+      break;
+    }
+    case FC_ENCAPSULATED_INTERFACE: {
+      if (buffer[8] != MEI_READ_DEVICE_ID) {
+        ESP_LOGW(TAG, "Unsupported MEI type: %u", buffer[8]);
+        this->count_(COUNTER_OTHER_FUNCTION);
+        this->send_error_(index, buffer, EX_ILLEGAL_FUNCTION);
+        break;
+      }
+      this->count_(COUNTER_DEVICE_ID);
+      this->handle_device_id_(index, buffer, device);
+      break;
+    }
+    default:
+      ESP_LOGW(TAG, "Unsupported function code: %u", function_code);
+      this->count_(COUNTER_OTHER_FUNCTION);
+      this->send_error_(index, buffer, EX_ILLEGAL_FUNCTION);
+      break;
+  }
+}
+
+bool ModbusTcpServer::readable_(uint8_t device, uint16_t reg_start, uint16_t reg_count) const {
+  // One window per read: the register image, the diagnostic block or the history window
+  uint32_t end = (uint32_t) reg_start + reg_count;
+  if (end <= RegisterImage::SIZE)
+    return true;
+  if (reg_start >= DIAG_OFFSET && end <= DIAG_OFFSET + DIAG_LENGTH)
+    return true;
+  const HistoryBuffer *history = this->histories_[device];
+  return history != nullptr && reg_start >= HISTORY_OFFSET &&
+         end <= (uint32_t) HISTORY_OFFSET + history->window_registers();
+}
+
+void ModbusTcpServer::send_read_(uint8_t index, uint8_t *request, uint8_t device, uint16_t reg_start,
+                                 uint16_t reg_count) {
+  // Diagnostic block: served from the live counters, read-only
+  if (reg_start >= DIAG_OFFSET && reg_start < DIAG_OFFSET + DIAG_LENGTH) {
+    this->send_diagnostics_(index, request, reg_start - DIAG_OFFSET, reg_count);
+  } else if (reg_start >= HISTORY_OFFSET) {
+    // History window: only for devices that keep one (checked by readable_()), read-only
+    this->send_history_(index, request, device, reg_start - HISTORY_OFFSET, reg_count);
+  } else {
+    this->count_chunk_reads_(device, reg_start, reg_count);
+    this->send_image_response_(index, request, device, reg_start, reg_count);
+  }
+}
+
+void ModbusTcpServer::count_chunk_reads_(uint8_t device, uint16_t reg_start, uint16_t reg_count) {
+  uint16_t last = (reg_start + reg_count - 1) / DEMAND_CHUNK;
+  if (last >= DEMAND_CHUNKS)
+    last = DEMAND_CHUNKS - 1;
+  for (uint16_t chunk = reg_start / DEMAND_CHUNK; chunk <= last; chunk++) {
+    std::atomic<uint8_t> &reads = this->chunk_reads_[device][chunk];
+    reads.store(reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+}
+
+size_t ModbusTcpServer::build_read_response_(uint8_t *response, const uint8_t *request, uint16_t reg_count) {
+  // Frame layout: fixed 9-byte header, then the register span in wire order — the
+  // caller copies that in at READ_RESPONSE_HEADER_SIZE.
+
+  // Copy MBAP header (transaction ID, protocol ID)
+  memcpy(response, request, 4);
+
+  // Length field (unit ID + function code + byte count + data)
+  uint16_t length = 3 + (reg_count * 2);
+  response[4] = length >> 8;
+  response[5] = length & 0xFF;
+
+  // Unit ID
+  response[6] = request[6];
+
+  // Function code (same as request)
+  response[7] = request[7];
+
+  // Byte count
+  response[8] = reg_count * 2;
+
+  return READ_RESPONSE_HEADER_SIZE + (reg_count * 2);
+}
+
+void ModbusTcpServer::send_response_(uint8_t index, uint8_t *request, const uint8_t *data, uint16_t reg_count) {
+  // Modbus FC03 max is 125 registers (250 bytes data + 9 header = 259 bytes)
+  if (reg_count > MAX_READ_REGISTERS) reg_count = MAX_READ_REGISTERS;
+  uint8_t response[MAX_READ_RESPONSE_SIZE];
+  size_t response_len = this->build_read_response_(response, request, reg_count);
+  memcpy(response + READ_RESPONSE_HEADER_SIZE, data, reg_count * 2);
+  this->write_(index, response, response_len);
+  ESP_LOGD(TAG, "Sent %u registers", reg_count);
+}
+
+void ModbusTcpServer::send_image_response_(uint8_t index, uint8_t *request, uint8_t device, uint16_t reg_start,
+                                           uint16_t reg_count) {
+  if (reg_count > MAX_READ_REGISTERS) reg_count = MAX_READ_REGISTERS;
+  RegisterImage *image = this->images_[device];
+  uint32_t generation = image->generation();
+  this->cache_clock_++;
+
+  // Hit: same range, function code and unit byte (so the same image), and no register changed since
+  CachedResponse *victim = &this->cache_[0];
+  for (CachedResponse &entry : this->cache_) {
+    if (entry.valid && entry.reg_start == reg_start && entry.reg_count == reg_count &&
+        entry.function_code == request[7] && entry.unit_id == request[6]) {
+      if (entry.generation == generation) {
+        this->count_(COUNTER_CACHE_HITS);
+        entry.last_used = this->cache_clock_;
+        entry.frame[0] = request[0];  // transaction ID
+        entry.frame[1] = request[1];
+        this->write_(index, entry.frame, entry.len);
+        ESP_LOGD(TAG, "Sent %u registers starting at %u (cached)", reg_count, reg_start);
+        return;
+      }
+      victim = &entry;  // stale copy of this range: rebuild in place
+      break;
+    }
+    if (!entry.valid || entry.last_used < victim->last_used)
+      victim = &entry;
+  }
+
+  // Miss: serialize into the least recently used (or stale) entry
+  this->count_(COUNTER_CACHE_MISSES);
+  victim->valid = true;
+  victim->function_code = request[7];
+  victim->unit_id = request[6];
+  victim->reg_start = reg_start;
+  victim->reg_count = reg_count;
+  victim->last_used = this->cache_clock_;
+  victim->len = this->build_read_response_(victim->frame, request, reg_count);
+  // Label the entry with the generation of the snapshot actually copied
+  victim->generation = image->read_wire(reg_start, reg_count, victim->frame + READ_RESPONSE_HEADER_SIZE);
+  this->write_(index, victim->frame, victim->len);
+  ESP_LOGD(TAG, "Sent %u registers starting at %u", reg_count, reg_start);
+}
+
+void ModbusTcpServer::send_diagnostics_(uint8_t index, uint8_t *request, uint16_t first, uint16_t reg_count) {
+  // Snapshot every counter in wire order, then send the requested span
+  uint8_t data[DIAG_LENGTH * 2];
+  for (uint8_t i = 0; i < COUNTER_COUNT; i++) {
+    uint32_t value = this->counters_[i].load(std::memory_order_relaxed);
+    data[i * 4] = value >> 24;
+    data[i * 4 + 1] = (value >> 16) & 0xFF;
+    data[i * 4 + 2] = (value >> 8) & 0xFF;
+    data[i * 4 + 3] = value & 0xFF;
+  }
+  this->send_response_(index, request, data + first * 2, reg_count);
+}
+
+void ModbusTcpServer::send_history_(uint8_t index, uint8_t *request, uint8_t device, uint16_t first,
+                                    uint16_t reg_count) {
+  uint8_t data[MAX_READ_REGISTERS * 2];
+  this->histories_[device]->read_registers(first, reg_count, data);
+  this->send_response_(index, request, data, reg_count);
+}
+
+void ModbusTcpServer::send_error_(uint8_t index, uint8_t *request, uint8_t error_code) {
+  if (error_code == EX_ILLEGAL_FUNCTION) {
+    this->count_(COUNTER_EX_ILLEGAL_FUNCTION);
+  } else if (error_code == EX_ILLEGAL_DATA_ADDRESS) {
+    this->count_(COUNTER_EX_ILLEGAL_ADDRESS);
+  } else {
+    this->count_(COUNTER_EX_ILLEGAL_VALUE);
+  }
+
+  uint8_t response[9];
+
+  // Copy MBAP header
+  memcpy(response, request, 4);
+
+  // Length field
+  response[4] = 0;
+  response[5] = 3;
+
+  // Unit ID
+  response[6] = request[6];
+
+  // Function code with error bit set
+  response[7] = request[7] | 0x80;
+
+  // Exception code
+  response[8] = error_code;
+
+  this->write_(index, response, 9);
+  ESP_LOGD(TAG, "Sent error response: %u", error_code);
+}
+
+void ModbusTcpServer::handle_write_single_(uint8_t index, uint8_t *buffer, uint8_t device) {
+  uint16_t reg_idx = register_index((buffer[8] << 8) | buffer[9]);
+  uint16_t value = (buffer[10] << 8) | buffer[11];
+
+  if (reg_idx >= RegisterImage::SIZE) {
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+
+  {
+    RegisterImage::WriteSection section(*this->images_[device]);
+    this->images_[device]->set_wire(reg_idx, buffer + 10, 1);
+  }
+  if (this->listener_ != nullptr)
+    this->listener_->on_registers_written(device, reg_idx, 1, this->frame_start_us_);
+
+  // Echo the request as response (FC06 standard)
+  this->write_(index, buffer, 12);
+  ESP_LOGD(TAG, "Write single reg %u = %u", reg_idx, value);
+}
+
+void ModbusTcpServer::handle_write_multiple_(uint8_t index, uint8_t *buffer, size_t len, uint8_t device) {
+  uint16_t reg_idx = register_index((buffer[8] << 8) | buffer[9]);
+  uint16_t quantity = (buffer[10] << 8) | buffer[11];
+
+  // Quantity, byte count and the frame length must all agree before any of the
+  // payload is trusted; a short or inconsistent request changes nothing
+  if (quantity == 0 || quantity > MAX_WRITE_REGISTERS || len < WRITE_MULTIPLE_HEADER_SIZE ||
+      buffer[12] != quantity * 2 || len < WRITE_MULTIPLE_HEADER_SIZE + quantity * 2) {
+    ESP_LOGW(TAG, "Malformed write multiple request (quantity %u, %u bytes)", quantity, (unsigned) len);
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+    return;
+  }
+
+  if (reg_idx + quantity > RegisterImage::SIZE) {
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+
+  // Payload is already in wire order
+  {
+    RegisterImage::WriteSection section(*this->images_[device]);
+    this->images_[device]->set_wire(reg_idx, buffer + WRITE_MULTIPLE_HEADER_SIZE, quantity);
+  }
+  if (this->listener_ != nullptr)
+    this->listener_->on_registers_written(device, reg_idx, quantity, this->frame_start_us_);
+
+  // Send FC16 response: MBAP + unit + FC + start_addr + quantity
+  uint8_t response[12];
+  memcpy(response, buffer, 4);  // Transaction + protocol ID
+  response[4] = 0;
+  response[5] = 6;  // Length = 6
+  response[6] = buffer[6];  // Unit ID
+  response[7] = FC_WRITE_MULTIPLE_REGISTERS;
+  response[8] = buffer[8];  // Start address hi
+  response[9] = buffer[9];  // Start address lo
+  response[10] = buffer[10]; // Quantity hi
+  response[11] = buffer[11]; // Quantity lo
+  this->write_(index, response, 12);
+  ESP_LOGD(TAG, "Write multiple %u regs starting at %u", quantity, reg_idx);
+}
+
+void ModbusTcpServer::handle_read_write_multiple_(uint8_t index, uint8_t *buffer, size_t len, uint8_t device) {
+  // Validated like FC03 + FC16 together, before anything is written: a request that
+  // would fail its read changes nothing either
+  if (len < READ_WRITE_MULTIPLE_HEADER_SIZE) {
+    ESP_LOGW(TAG, "Short read/write multiple request (%u bytes)", (unsigned) len);
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  uint16_t read_start = register_index((buffer[8] << 8) | buffer[9]);
+  uint16_t read_quantity = (buffer[10] << 8) | buffer[11];
+  uint16_t write_start = register_index((buffer[12] << 8) | buffer[13]);
+  uint16_t write_quantity = (buffer[14] << 8) | buffer[15];
+
+  if (read_quantity == 0 || read_quantity > MAX_READ_REGISTERS || write_quantity == 0 ||
+      write_quantity > MAX_READ_WRITE_REGISTERS || buffer[16] != write_quantity * 2 ||
+      len < READ_WRITE_MULTIPLE_HEADER_SIZE + write_quantity * 2) {
+    ESP_LOGW(TAG, "Malformed read/write multiple request (read %u, write %u, %u bytes)", read_quantity,
+             write_quantity, (unsigned) len);
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (write_start + write_quantity > RegisterImage::SIZE || !this->readable_(device, read_start, read_quantity)) {
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+
+  // The write happens before the read, so the response reflects it
+  {
+    RegisterImage::WriteSection section(*this->images_[device]);
+    this->images_[device]->set_wire(write_start, buffer + READ_WRITE_MULTIPLE_HEADER_SIZE, write_quantity);
+  }
+  if (this->listener_ != nullptr)
+    this->listener_->on_registers_written(device, write_start, write_quantity, this->frame_start_us_);
+
+  // Response has the FC03 layout (byte count + registers)
+  this->send_read_(index, buffer, device, read_start, read_quantity);
+  ESP_LOGD(TAG, "Read/write multiple: wrote %u regs at %u, read %u regs at %u", write_quantity, write_start,
+           read_quantity, read_start);
+}
+
+void ModbusTcpServer::handle_device_id_(uint8_t index, uint8_t *buffer, uint8_t device) {
+  uint8_t read_code = buffer[9];
+  uint8_t object_id = buffer[10];
+
+  // Read codes 1-3 stream a category from object_id (basic 0x00-0x02, regular up to
+  // 0x7F, extended up to 0xFF, each including the ones before); 4 reads one object
+  static const uint8_t LAST_OBJECT[] = {0x02, 0x7F, 0xFF};
+  if (read_code < 1 || read_code > 4) {
+    ESP_LOGW(TAG, "Invalid device identification read code %u", read_code);
+    this->send_error_(index, buffer, EX_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  bool known = false;
+  for (const DeviceIdObject &object : DEVICE_ID_OBJECTS)
+    known |= object.id == object_id;
+  uint8_t first = object_id;
+  uint8_t last = object_id;
+  if (read_code == 4) {
+    if (!known) {
+      this->send_error_(index, buffer, EX_ILLEGAL_DATA_ADDRESS);
+      return;
+    }
+  } else {
+    last = LAST_OBJECT[read_code - 1];
+    if (!known || object_id > last)
+      first = 0;  // per spec, an unknown start object restarts the stream
+  }
+
+  uint8_t strings[DEVICE_ID_STRINGS * 2];
+  this->images_[device]->read_wire(MODEL1_DATA_OFFSET, DEVICE_ID_STRINGS, strings);
+
+  uint8_t response[MAX_ADU_SIZE];
+  memcpy(response, buffer, 4);  // Transaction + protocol ID
+  response[6] = buffer[6];
+  response[7] = FC_ENCAPSULATED_INTERFACE;
+  response[8] = MEI_READ_DEVICE_ID;
+  response[9] = read_code;
+  response[10] = DEVICE_ID_CONFORMITY;
+  response[11] = 0;  // more follows
+  response[12] = 0;  // next object ID
+  uint8_t count = 0;
+  size_t pos = 14;
+  for (const DeviceIdObject &object : DEVICE_ID_OBJECTS) {
+    if (object.id < first || object.id > last)
+      continue;
+    // Model 1 strings are NUL padded
+    const uint8_t *value = strings + object.offset * 2;
+    uint8_t length = 0;
+    while (length < object.length && value[length] != 0)
+      length++;
+    response[pos++] = object.id;
+    response[pos++] = length;
+    memcpy(response + pos, value, length);
+    pos += length;
+    count++;
+  }
+  response[13] = count;
+  uint16_t length = pos - 6;
+  response[4] = length >> 8;
+  response[5] = length & 0xFF;
+  this->write_(index, response, pos);
+  ESP_LOGD(TAG, "Device identification: read code %u, %u objects", read_code, count);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "modbus_transport.h"
+#include "register_image.h"
+#include "history.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Per-connection receive ring buffer size (power of two). Holds at least one maximum
+// size ADU (260 bytes) plus a batch of pipelined read requests.
+static const uint16_t RX_BUFFER_SIZE = 512;
+
+// Largest FC03/FC04 response: MBAP (7) + FC + byte count + 125 registers
+static const uint16_t MAX_READ_REGISTERS = 125;
+static const uint16_t MAX_READ_RESPONSE_SIZE = 9 + MAX_READ_REGISTERS * 2;
+
+// Serialized read responses kept for repeated polls of the same range
+static const uint8_t RESPONSE_CACHE_ENTRIES = 4;
+
+// SunSpec devices (register images) one server can host, each under its own unit ID
+static const uint8_t MAX_DEVICES = 8;
+static const int DEVICE_NONE = -1;
+
+// Image reads are tallied per DEMAND_CHUNK registers, so the component can tell which
+// values clients actually poll; DEMAND_CHUNKS cover the whole SunSpec chain
+static const uint16_t DEMAND_CHUNK = 8;
+static const uint8_t DEMAND_CHUNKS = 32;
+
+// One Modbus TCP connection slot with its own idle timer and accounting
+struct ClientSlot {
+  bool connected{false};
+  uint8_t rx_buf[RX_BUFFER_SIZE];  // ring buffer of received bytes not yet framed
+  uint16_t rx_head{0};             // index of first unconsumed byte
+  uint16_t rx_len{0};              // number of unconsumed bytes
+  uint32_t connected_ms{0};  // millis() at accept
+  uint32_t last_rx_ms{0};    // millis() of last received request (idle timeout reference)
+  uint32_t requests{0};      // requests processed on this connection
+  uint32_t bytes_in{0};
+  uint32_t bytes_out{0};
+};
+
+// Server-wide counters. The order is also the register order of the read-only
+// diagnostic block (two registers per counter, high word first).
+enum ServerCounter : uint8_t {
+  COUNTER_READ_HOLDING,         // FC03 requests
+  COUNTER_READ_INPUT,           // FC04 requests
+  COUNTER_WRITE_SINGLE,         // FC06 requests
+  COUNTER_WRITE_MULTIPLE,       // FC16 requests
+  COUNTER_OTHER_FUNCTION,       // requests with an unsupported function code
+  COUNTER_EX_ILLEGAL_FUNCTION,  // exception responses sent, by exception code
+  COUNTER_EX_ILLEGAL_ADDRESS,
+  COUNTER_EX_ILLEGAL_VALUE,
+  COUNTER_BYTES_IN,
+  COUNTER_BYTES_OUT,
+  COUNTER_DROPPED_PROTOCOL,  // frames ignored for protocol_id != 0
+  COUNTER_DROPPED_UNIT,      // frames ignored for a foreign unit ID
+  COUNTER_INVALID_FRAMES,    // connections closed for an invalid MBAP header
+  COUNTER_ACCEPTS,
+  COUNTER_REJECTS,   // connections refused with all slots in use
+  COUNTER_TIMEOUTS,  // connections closed by the idle timeout
+  COUNTER_CACHE_HITS,    // register reads answered from the response cache
+  COUNTER_CACHE_MISSES,  // register reads that had to be serialized
+  COUNTER_READ_WRITE_MULTIPLE,  // FC23 requests
+  COUNTER_DEVICE_ID,            // FC43/14 requests
+  COUNTER_COUNT,
+};
+
+static const uint16_t DIAG_LENGTH = COUNTER_COUNT * 2;
+
+// Per-device sample history window at a fixed vendor address (41000), clear of
+// the SunSpec chain and the diagnostic block as they grow
+static const uint16_t HISTORY_OFFSET = 1000;
+static_assert(DIAG_OFFSET + DIAG_LENGTH <= HISTORY_OFFSET, "history window overlaps the diagnostic block");
+
+// A fully serialized read response. Valid while the image generation is unchanged;
+// only the transaction ID is patched per request.
+struct CachedResponse {
+  bool valid{false};
+  uint8_t function_code{0};
+  uint8_t unit_id{0};
+  uint16_t reg_start{0};
+  uint16_t reg_count{0};
+  uint16_t len{0};
+  uint32_t generation{0};
+  uint32_t last_used{0};  // request sequence number, for least-recently-used eviction
+  uint8_t frame[MAX_READ_RESPONSE_SIZE];
+};
+
+// Events from the server loop. When the server runs on its own task these are
+// called on that task (see ServerTask).
+class ServerListener {
+ public:
+  // A client changed registers of device (index from add_device()) with FC06/FC16/FC23;
+  // received_us is micros() when the request frame was complete
+  virtual void on_registers_written(uint8_t device, uint16_t reg_start, uint16_t reg_count, uint32_t received_us) = 0;
+  // Frame complete → response written, in µs (only with set_request_timing(true))
+  virtual void on_request_latency(uint32_t us) {}
+};
+
+// Modbus TCP protocol core: connection table, MBAP framing and the FC03/04/06/16/23
+// and FC43/14 handlers over wire-order register images, one per served unit ID.
+// Independent of ESPHome components and of the socket API (see ModbusTransport), so
+// the same code serves WiFi on the ESP and epoll on a Linux host.
+class ModbusTcpServer {
+ public:
+  void set_transport(ModbusTransport *transport) { this->transport_ = transport; }
+  void set_listener(ServerListener *listener) { this->listener_ = listener; }
+  // Serve image (and optionally a history window) under unit_id. Returns the device
+  // index passed to the listener, or DEVICE_NONE if the unit ID is taken or
+  // MAX_DEVICES are registered. Unit ID 0 (broadcast) is answered by device 0.
+  int add_device(uint8_t unit_id, RegisterImage *image, const HistoryBuffer *history = nullptr);
+  void set_max_clients(uint8_t max_clients) {
+    this->max_clients_ = max_clients > MAX_CLIENTS_LIMIT ? MAX_CLIENTS_LIMIT : max_clients;
+  }
+  void set_client_timeout(uint32_t client_timeout) { this->client_timeout_ = client_timeout; }
+  void set_request_timing(bool time_requests) { this->time_requests_ = time_requests; }
+
+  uint8_t get_device_count() const { return this->device_count_; }
+  uint8_t get_max_clients() const { return this->max_clients_; }
+  uint32_t get_client_timeout() const { return this->client_timeout_; }
+  // Safe to call from any task
+  uint32_t get_counter(ServerCounter counter) const {
+    return this->counters_[counter].load(std::memory_order_relaxed);
+  }
+  // Reads of device's image that touched chunk (registers chunk * DEMAND_CHUNK onwards),
+  // wrapping at 256; compare with an earlier value. Safe to call from any task.
+  uint8_t get_chunk_reads(uint8_t device, uint8_t chunk) const {
+    return this->chunk_reads_[device][chunk].load(std::memory_order_relaxed);
+  }
+
+  // Allocates the connection slots; call once, after set_max_clients()
+  bool begin(uint16_t port);
+  // Accept new connections, then serve every connected slot once
+  void loop(uint32_t now);
+
+ protected:
+  // Counters have a single writer (the server loop), so no read-modify-write atomics needed
+  void count_(ServerCounter counter, uint32_t amount = 1) {
+    this->counters_[counter].store(this->counters_[counter].load(std::memory_order_relaxed) + amount,
+                                   std::memory_order_relaxed);
+  }
+  void accept_clients_(uint32_t now);
+  void handle_client_(uint8_t index, uint32_t now);
+  void close_client_(uint8_t index, uint32_t now, const char *reason);
+  void receive_(uint8_t index, uint32_t now);
+  bool process_frames_(uint8_t index);
+  void write_(uint8_t index, const uint8_t *data, size_t len);
+  void process_request_(uint8_t index, uint8_t *buffer, size_t len);
+  bool readable_(uint8_t device, uint16_t reg_start, uint16_t reg_count) const;
+  void send_read_(uint8_t index, uint8_t *request, uint8_t device, uint16_t reg_start, uint16_t reg_count);
+  void count_chunk_reads_(uint8_t device, uint16_t reg_start, uint16_t reg_count);
+  size_t build_read_response_(uint8_t *response, const uint8_t *request, uint16_t reg_count);
+  void send_response_(uint8_t index, uint8_t *request, const uint8_t *data, uint16_t reg_count);
+  void send_image_response_(uint8_t index, uint8_t *request, uint8_t device, uint16_t reg_start,
+                            uint16_t reg_count);
+  void send_diagnostics_(uint8_t index, uint8_t *request, uint16_t first, uint16_t reg_count);
+  void send_history_(uint8_t index, uint8_t *request, uint8_t device, uint16_t first, uint16_t reg_count);
+  void send_error_(uint8_t index, uint8_t *request, uint8_t error_code);
+  void handle_write_single_(uint8_t index, uint8_t *buffer, uint8_t device);
+  void handle_write_multiple_(uint8_t index, uint8_t *buffer, size_t len, uint8_t device);
+  void handle_read_write_multiple_(uint8_t index, uint8_t *buffer, size_t len, uint8_t device);
+  void handle_device_id_(uint8_t index, uint8_t *buffer, uint8_t device);
+
+  ModbusTransport *transport_{nullptr};
+  ServerListener *listener_{nullptr};
+
+  RegisterImage *images_[MAX_DEVICES]{};
+  const HistoryBuffer *histories_[MAX_DEVICES]{};
+  uint8_t device_count_{0};
+  uint8_t unit_devices_[256]{};  // device index + 1 per unit ID, 0 = not served
+  uint8_t max_clients_{4};
+  uint32_t client_timeout_{30000};  // per-slot: 30 s without data → force disconnect
+
+  std::unique_ptr<ClientSlot[]> clients_;  // max_clients_ slots (512-byte ring each), allocated in begin()
+  uint8_t next_slot_{0};  // round-robin start so no slot is always served first
+  std::atomic<uint32_t> counters_[COUNTER_COUNT]{};
+  std::atomic<uint8_t> chunk_reads_[MAX_DEVICES][DEMAND_CHUNKS]{};  // single writer, like counters_
+  bool time_requests_{false};
+  CachedResponse cache_[RESPONSE_CACHE_ENTRIES];
+  uint32_t cache_clock_{0};
+  uint32_t frame_start_us_{0};  // micros() when the frame being processed was complete
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
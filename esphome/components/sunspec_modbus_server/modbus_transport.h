@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Upper bound for the connection table (max_clients is validated against this in __init__.py)
+static const uint8_t MAX_CLIENTS_LIMIT = 8;
+
+// Return values of ModbusTransport::accept() when no slot was filled
+static const int ACCEPT_NONE = -1;      // nothing pending
+static const int ACCEPT_REJECTED = -2;  // a connection was pending but all slots are in use
+
+// Byte-stream transport underneath the Modbus TCP server.
+//
+// Connections are addressed by slot index (0 .. max_clients-1). The transport owns
+// the sockets; framing, timeouts and accounting stay in ModbusTcpServer so every
+// backend behaves the same. All calls are non-blocking.
+class ModbusTransport {
+ public:
+  virtual ~ModbusTransport() = default;
+
+  // Start listening on port; at most max_clients connections are kept open
+  virtual bool begin(uint16_t port, uint8_t max_clients) = 0;
+  // Collect readiness once per server loop (no-op for backends that poll per call)
+  virtual void poll() {}
+  // Block up to timeout_ms for socket activity, for a server running on its own task.
+  // Returns false if the backend cannot block; the caller then sleeps instead.
+  virtual bool wait(int timeout_ms) { return false; }
+  // Accept one pending connection into a free slot. Returns the slot index,
+  // ACCEPT_NONE or ACCEPT_REJECTED (the pending connection was closed).
+  virtual int accept() = 0;
+  virtual bool connected(uint8_t slot) = 0;
+  // Read up to len bytes that are already buffered; returns 0 when nothing is pending
+  virtual int read(uint8_t slot, uint8_t *buf, size_t len) = 0;
+  virtual size_t write(uint8_t slot, const uint8_t *data, size_t len) = 0;
+  virtual void close(uint8_t slot) = 0;
+  // Peer address as text (for logging), written into buf without allocating
+  virtual void get_remote_address(uint8_t slot, char *buf, size_t len) = 0;
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,172 @@
+#ifdef __linux__
+
+#include "posix_transport.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static_assert(MAX_CLIENTS_LIMIT <= 32, "ready_mask_ holds one bit per slot");
+
+PosixTransport::PosixTransport() {
+  for (int &fd : this->fds_)
+    fd = -1;
+}
+
+PosixTransport::~PosixTransport() {
+  for (uint8_t i = 0; i < MAX_CLIENTS_LIMIT; i++) {
+    if (this->fds_[i] >= 0)
+      ::close(this->fds_[i]);
+  }
+  if (this->listen_fd_ >= 0)
+    ::close(this->listen_fd_);
+  if (this->epoll_fd_ >= 0)
+    ::close(this->epoll_fd_);
+}
+
+bool PosixTransport::begin(uint16_t port, uint8_t max_clients) {
+  this->max_clients_ = max_clients > MAX_CLIENTS_LIMIT ? MAX_CLIENTS_LIMIT : max_clients;
+
+  this->listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (this->listen_fd_ < 0)
+    return false;
+  int one = 1;
+  setsockopt(this->listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(this->listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(this->listen_fd_, MAX_CLIENTS_LIMIT) < 0)
+    return false;
+
+  this->epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (this->epoll_fd_ < 0)
+    return false;
+  struct epoll_event ev {};
+  ev.events = EPOLLIN;
+  ev.data.u32 = LISTEN_TAG;
+  return epoll_ctl(this->epoll_fd_, EPOLL_CTL_ADD, this->listen_fd_, &ev) == 0;
+}
+
+bool PosixTransport::wait(int timeout_ms) {
+  struct epoll_event events[MAX_CLIENTS_LIMIT + 1];
+  int n = epoll_wait(this->epoll_fd_, events, MAX_CLIENTS_LIMIT + 1, timeout_ms);
+  for (int i = 0; i < n; i++) {
+    uint32_t tag = events[i].data.u32;
+    if (tag == LISTEN_TAG) {
+      this->listen_ready_ = true;
+    } else if (tag < MAX_CLIENTS_LIMIT) {
+      // EPOLLHUP/EPOLLERR also mark the slot readable so read() observes the close
+      this->ready_mask_ |= 1U << tag;
+    }
+  }
+  return true;
+}
+
+int PosixTransport::accept() {
+  if (!this->listen_ready_)
+    return ACCEPT_NONE;
+
+  struct sockaddr_in addr {};
+  socklen_t addr_len = sizeof(addr);
+  int fd = accept4(this->listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), &addr_len,
+                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    // Backlog drained (EAGAIN) or transient error — wait for the next epoll round
+    this->listen_ready_ = false;
+    return ACCEPT_NONE;
+  }
+
+  for (uint8_t i = 0; i < this->max_clients_; i++) {
+    if (this->fds_[i] >= 0)
+      continue;
+    // Small request/response frames: send immediately instead of waiting for Nagle
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct epoll_event ev {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = i;
+    if (epoll_ctl(this->epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+      break;
+    this->fds_[i] = fd;
+    this->peer_closed_[i] = false;
+    this->ready_mask_ &= ~(1U << i);
+    this->remote_ip_[i] = ntohl(addr.sin_addr.s_addr);
+    this->remote_port_[i] = ntohs(addr.sin_port);
+    return i;
+  }
+
+  ::close(fd);
+  return ACCEPT_REJECTED;
+}
+
+int PosixTransport::read(uint8_t slot, uint8_t *buf, size_t len) {
+  if ((this->ready_mask_ & (1U << slot)) == 0 || this->fds_[slot] < 0)
+    return 0;
+
+  ssize_t n = recv(this->fds_[slot], buf, len, MSG_DONTWAIT);
+  if (n > 0) {
+    // A short read means the socket buffer is empty; otherwise keep the slot
+    // marked so the caller can continue draining without another epoll round
+    if ((size_t) n < len)
+      this->ready_mask_ &= ~(1U << slot);
+    return (int) n;
+  }
+  this->ready_mask_ &= ~(1U << slot);
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    this->peer_closed_[slot] = true;
+  return 0;
+}
+
+size_t PosixTransport::write(uint8_t slot, const uint8_t *data, size_t len) {
+  // After a short send nothing more goes out, not even a later pipelined response
+  if (this->peer_closed_[slot])
+    return 0;
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = send(this->fds_[slot], data + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    // Responses are at most 260 bytes, so a full send buffer means the peer stopped
+    // reading. A partial frame would desynchronize the stream for good, so close the
+    // connection (the core sees !connected()) rather than block the server loop.
+    this->peer_closed_[slot] = true;
+    break;
+  }
+  return sent;
+}
+
+void PosixTransport::close(uint8_t slot) {
+  if (this->fds_[slot] < 0)
+    return;
+  epoll_ctl(this->epoll_fd_, EPOLL_CTL_DEL, this->fds_[slot], nullptr);
+  ::close(this->fds_[slot]);
+  this->fds_[slot] = -1;
+  this->peer_closed_[slot] = false;
+  this->ready_mask_ &= ~(1U << slot);
+}
+
+void PosixTransport::get_remote_address(uint8_t slot, char *buf, size_t len) {
+  uint32_t ip = this->remote_ip_[slot];
+  snprintf(buf, len, "%u.%u.%u.%u:%u", (unsigned) (ip >> 24), (unsigned) ((ip >> 16) & 0xFF),
+           (unsigned) ((ip >> 8) & 0xFF), (unsigned) (ip & 0xFF), this->remote_port_[slot]);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // __linux__
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "modbus_transport.h"
+
+#include <sys/epoll.h>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Linux backend: non-blocking sockets multiplexed with a level-triggered epoll set.
+// Used by the ESPHome host platform so the server can run and be measured on a workstation.
+class PosixTransport : public ModbusTransport {
+ public:
+  PosixTransport();
+  ~PosixTransport() override;
+
+  bool begin(uint16_t port, uint8_t max_clients) override;
+  void poll() override { this->wait(0); }
+  int accept() override;
+  bool connected(uint8_t slot) override { return this->fds_[slot] >= 0 && !this->peer_closed_[slot]; }
+  int read(uint8_t slot, uint8_t *buf, size_t len) override;
+  size_t write(uint8_t slot, const uint8_t *data, size_t len) override;
+  void close(uint8_t slot) override;
+  void get_remote_address(uint8_t slot, char *buf, size_t len) override;
+  bool wait(int timeout_ms) override;
+
+ protected:
+  static const uint32_t LISTEN_TAG = 0xFF;  // epoll data for the listening socket
+
+  int listen_fd_{-1};
+  int epoll_fd_{-1};
+  int fds_[MAX_CLIENTS_LIMIT];  // -1 = free slot
+  bool peer_closed_[MAX_CLIENTS_LIMIT]{};
+  uint32_t remote_ip_[MAX_CLIENTS_LIMIT]{};  // host byte order
+  uint16_t remote_port_[MAX_CLIENTS_LIMIT]{};
+  uint8_t max_clients_{0};
+  bool listen_ready_{false};
+  uint32_t ready_mask_{0};  // bit n: slot n has data (or EOF) to read
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // __linux__
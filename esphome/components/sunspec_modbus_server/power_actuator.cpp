@@ -0,0 +1,68 @@
+#include "power_actuator.h"
+
+#include <cmath>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+bool PowerLimitActuator::command(float target, uint32_t ramp_ms, uint32_t now) {
+  if (this->has_target_) {
+    if (target == this->target_)
+      return false;
+    bool endpoint = target <= 0.0f || target >= 100.0f;
+    if (!endpoint && fabsf(target - this->target_) < this->deadband_)
+      return false;
+  }
+
+  // Ramp from wherever the output currently is
+  this->ramp_start_value_ = this->has_output_ ? this->output_ : target;
+  this->ramp_start_ms_ = now;
+  this->ramp_ms_ = ramp_ms;
+  this->target_ = target;
+  this->has_target_ = true;
+  return true;
+}
+
+bool PowerLimitActuator::update(uint32_t now, float &output) {
+  if (!this->has_target_ || this->is_settled())
+    return false;
+  if (this->has_output_ && now - this->last_write_ms_ < this->interval_)
+    return false;
+
+  float value = this->reference(now);
+  if (this->has_output_ && value == this->output_)
+    return false;
+
+  this->output_ = value;
+  this->has_output_ = true;
+  this->last_write_ms_ = now;
+  output = value;
+  return true;
+}
+
+float PowerLimitActuator::reference(uint32_t now) const {
+  uint32_t elapsed = now - this->ramp_start_ms_;
+  if (this->ramp_ms_ == 0 || elapsed >= this->ramp_ms_)
+    return this->target_;
+  float progress = (float) elapsed / (float) this->ramp_ms_;
+  return this->ramp_start_value_ + (this->target_ - this->ramp_start_value_) * progress;
+}
+
+bool PowerLimitActuator::pace(float value, uint32_t now, float min_step) {
+  if (this->has_output_) {
+    if (value == this->output_ || now - this->last_write_ms_ < this->interval_)
+      return false;
+    bool endpoint = value <= 0.0f || value >= 100.0f;
+    float step = min_step > this->deadband_ ? min_step : this->deadband_;
+    if (!endpoint && fabsf(value - this->output_) < step)
+      return false;
+  }
+
+  this->output_ = value;
+  this->has_output_ = true;
+  this->last_write_ms_ = now;
+  return true;
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Turns Model 123 power limit commands into as few downstream writes as possible.
+//
+// Every downstream write is a Modbus RTU transaction on the inverter's slow RS485
+// link, so the actuator:
+//  - drops commands that do not move the target by more than the deadband
+//    (0 % and 100 % always pass, so a released limit is never swallowed)
+//  - sends at most one write per interval; a command arriving inside the interval
+//    is coalesced and the latest target goes out when the interval ends
+//  - ramps toward the target over WMaxLimPct_RmpTms, one step per interval
+class PowerLimitActuator {
+ public:
+  void set_deadband(float deadband) { this->deadband_ = deadband; }
+  void set_interval(uint32_t interval) { this->interval_ = interval; }
+  float get_deadband() const { return this->deadband_; }
+  uint32_t get_interval() const { return this->interval_; }
+
+  // New target in percent; ramp_ms = 0 applies it in one step. Returns false when the
+  // command was dropped (unchanged or inside the deadband).
+  bool command(float target, uint32_t ramp_ms, uint32_t now);
+  // Returns true (and the value to write) when a downstream write is due
+  bool update(uint32_t now, float &output);
+
+  // Closed loop (PowerLimitController): the ramped target at now, and whether value,
+  // computed from it, should be written now. Same interval as update(); changes smaller
+  // than min_step or the deadband are held back, except to reach 0 % or 100 %.
+  bool has_target() const { return this->has_target_; }
+  float reference(uint32_t now) const;
+  bool pace(float value, uint32_t now, float min_step);
+
+  float get_target() const { return this->target_; }
+  bool is_settled() const { return this->has_output_ && this->output_ == this->target_; }
+
+ protected:
+  float deadband_{0.0f};
+  uint32_t interval_{1000};
+
+  float target_{100.0f};
+  bool has_target_{false};
+  float ramp_start_value_{100.0f};
+  uint32_t ramp_start_ms_{0};
+  uint32_t ramp_ms_{0};
+
+  float output_{100.0f};  // last value written downstream
+  bool has_output_{false};
+  uint32_t last_write_ms_{0};
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
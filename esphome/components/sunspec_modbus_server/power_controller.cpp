@@ -0,0 +1,85 @@
+#include "power_controller.h"
+
+#include <cmath>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static constexpr int32_t Q16_ONE = 1L << 16;
+static constexpr int32_t FULL = 100 * Q16_ONE;    // 100 %
+static constexpr int32_t MAX_TRIM = 5 * Q16_ONE;  // integral band, and most the output may exceed the reference
+static constexpr int32_t SETTLED = Q16_ONE;       // reference model within 1 % of the reference
+static constexpr uint32_t MAX_STEP_MS = 1000;     // longer gaps (a blocked loop) count as 1 s
+
+static int32_t to_q16(float value) { return (int32_t) lroundf(value * (float) Q16_ONE); }
+
+static int32_t clamp_q16(int32_t value, int32_t low, int32_t high) {
+  if (value < low)
+    return low;
+  if (value > high)
+    return high;
+  return value;
+}
+
+// One first-order lag step toward target with time constant tau_ms
+static int32_t lag(int32_t value, int32_t target, uint32_t dt, uint32_t tau_ms) {
+  return value + (int32_t) ((int64_t) (target - value) * dt / (tau_ms + dt));
+}
+
+void PowerLimitController::configure(float bandwidth, float response_time, float proportional) {
+  this->bandwidth_ = bandwidth;
+  this->response_time_ = response_time;
+  this->proportional_ = proportional;
+  this->lag_ms_ = (uint32_t) lroundf(response_time * 500.0f);  // two lags of half the response time
+  this->kp_ = to_q16(proportional);
+  this->ki_ = to_q16(2.0f * (float) M_PI * bandwidth);
+  this->enabled_ = true;
+  this->reset();
+}
+
+void PowerLimitController::reset() {
+  this->integral_ = 0;
+  this->running_ = false;
+}
+
+float PowerLimitController::update(float reference, float measured, uint32_t now) {
+  int32_t ref = to_q16(reference);
+  int32_t actual = to_q16(measured);
+  uint32_t dt = this->running_ ? now - this->last_ms_ : 0;
+  if (dt > MAX_STEP_MS)
+    dt = MAX_STEP_MS;
+  this->last_ms_ = now;
+
+  // What the inverter should deliver by now: the reference through two lags, starting from
+  // the measurement. Correcting only deviations from this keeps a step of the limit from
+  // driving the output toward 0 % or 100 % while the inverter is still on its way.
+  if (!this->running_) {
+    this->lagged_ = actual;
+    this->expected_ = actual;
+    this->running_ = true;
+  }
+  this->lagged_ = lag(this->lagged_, ref, dt, this->lag_ms_);
+  this->expected_ = lag(this->expected_, this->lagged_, dt, this->lag_ms_);
+  int32_t error = this->expected_ - actual;
+
+  int32_t high = ref + MAX_TRIM < FULL ? ref + MAX_TRIM : FULL;
+  int32_t proportional = (int32_t) (((int64_t) this->kp_ * error) >> 16);
+  int32_t output = ref + proportional + this->integral_;
+
+  // Anti-windup. The integral only learns the steady offset between rate and output: not
+  // while the reference model is still moving, not on errors beyond the trim band (the sun
+  // limits the output, or a transient), and not while the output is pinned and the error
+  // would push it further out.
+  bool moving = ref - this->expected_ > SETTLED || this->expected_ - ref > SETTLED;
+  bool large = error > MAX_TRIM || error < -MAX_TRIM;
+  bool pinned = (output >= high && error > 0) || (output <= 0 && error < 0);
+  if (!moving && !large && !pinned && dt > 0) {
+    int64_t step = (int64_t) this->ki_ * error * dt / (1000LL * Q16_ONE);
+    this->integral_ = clamp_q16(this->integral_ + (int32_t) step, -FULL, MAX_TRIM);
+    output = ref + proportional + this->integral_;
+  }
+  return (float) clamp_q16(output, 0, high) / (float) Q16_ONE;
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
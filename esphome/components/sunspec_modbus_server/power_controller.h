@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Closed-loop power limiting: a PI controller that trims the rate sent to the inverter
+// until the measured AC power matches the Model 123 limit.
+//
+// The open-loop rate (the ramped WMaxLimPct) is fed forward, so the controller only
+// corrects what the inverter gets wrong, e.g. a rate that does not map exactly onto
+// max_power. It compares the measurement with a model of the inverter's own response
+// (response_time) rather than with the limit itself, and integrates at 2π·bandwidth.
+// The proportional gain defaults to 0: with the measurement and the writes each paced
+// at about a second, proportional action makes a slow inverter ring.
+//
+// The output never exceeds the open-loop rate by more than MAX_TRIM, so a sun-limited
+// inverter cannot wind the controller up and overshoot when the sun comes back.
+//
+// Arithmetic is Q16.16 fixed point in percent, so it costs the same on ESP8266, which
+// has no FPU.
+class PowerLimitController {
+ public:
+  void configure(float bandwidth, float response_time, float proportional);
+  bool is_enabled() const { return this->enabled_; }
+  float get_bandwidth() const { return this->bandwidth_; }
+  float get_response_time() const { return this->response_time_; }
+  float get_proportional() const { return this->proportional_; }
+
+  // One step: reference is the open-loop rate (%), measured the AC power in percent of
+  // max_power. Returns the rate to command (%).
+  float update(float reference, float measured, uint32_t now);
+  // Drop the integral, e.g. when the limit is released or the measurement is lost
+  void reset();
+
+ protected:
+  bool enabled_{false};
+  float bandwidth_{0.0f};      // Hz
+  float response_time_{0.0f};  // s
+  float proportional_{0.0f};
+  uint32_t lag_ms_{1};
+  int32_t kp_{0};  // Q16.16
+  int32_t ki_{0};  // Q16.16, per second
+
+  // Q16.16 percent: reference model stages and the integral
+  int32_t lagged_{0};
+  int32_t expected_{0};
+  int32_t integral_{0};
+  uint32_t last_ms_{0};
+  bool running_{false};
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,57 @@
+#include "register_image.h"
+
+#if defined(USE_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// A reader or writer that keeps losing the race may be spinning against a preempted
+// task on the same core; after a few tries give that task a chance to run.
+static const uint8_t SPINS_BEFORE_YIELD = 16;
+
+void seqlock_backoff(uint8_t &spins) {
+  if (++spins < SPINS_BEFORE_YIELD)
+    return;
+  spins = 0;
+#if defined(USE_ESP32)
+  vTaskDelay(1);
+#elif defined(__linux__)
+  sched_yield();
+#endif
+}
+
+void RegisterImage::begin_write_() {
+  uint8_t spins = 0;
+  while (this->writer_.test_and_set(std::memory_order_acquire))
+    seqlock_backoff(spins);
+  this->sequence_.store(this->sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void RegisterImage::end_write_() {
+  this->sequence_.store(this->sequence_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  this->writer_.clear(std::memory_order_release);
+}
+
+uint32_t RegisterImage::read_wire(uint16_t index, uint16_t count, uint8_t *dest) const {
+  uint8_t spins = 0;
+  while (true) {
+    uint32_t before = this->sequence_.load(std::memory_order_acquire);
+    if ((before & 1) == 0) {
+      memcpy(dest, &this->bytes_[index * 2], count * 2);
+      uint32_t generation = this->generation_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (this->sequence_.load(std::memory_order_relaxed) == before)
+        return generation;
+    }
+    seqlock_backoff(spins);
+  }
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
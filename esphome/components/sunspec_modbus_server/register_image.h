@@ -0,0 +1,88 @@
+#pragma once
+
+#include "sunspec_registers.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Spin-wait step for seqlock readers/writers: yields to other tasks after a few spins
+void seqlock_backoff(uint8_t &spins);
+
+// The SunSpec register block, stored pre-encoded in Modbus wire order (big-endian).
+//
+// Values are encoded once when they are set (update pass, client writes), so a
+// read response is the MBAP/PDU header followed by one copy of a span of this image.
+// generation() changes whenever any register value changes, so readers and caches
+// can detect "nothing new" with one comparison.
+//
+// The image is published through a seqlock so the server can read it from another
+// task (or thread on the Linux host) without a mutex on the request path:
+//  - writers group related stores (e.g. WH_HI/WH_LO) in a WriteSection; sections
+//    from different tasks are serialized by a small writer lock
+//  - readers copy a span with read_wire() and retry if a section was open or
+//    completed meanwhile, so they always see one consistent snapshot
+// Never read the image while holding a WriteSection on the same task.
+class RegisterImage {
+ public:
+  static const uint16_t SIZE = TOTAL_REGISTERS;
+
+  class WriteSection {
+   public:
+    explicit WriteSection(RegisterImage &image) : image_(image) { this->image_.begin_write_(); }
+    ~WriteSection() { this->image_.end_write_(); }
+    WriteSection(const WriteSection &) = delete;
+    WriteSection &operator=(const WriteSection &) = delete;
+
+   protected:
+    RegisterImage &image_;
+  };
+
+  RegisterImage() { memset(this->bytes_, 0, sizeof(this->bytes_)); }
+
+  // Readers (any task)
+  uint16_t get(uint16_t index) const {
+    uint8_t raw[2];
+    this->read_wire(index, 1, raw);
+    return (raw[0] << 8) | raw[1];
+  }
+  // Copy count registers in wire order; returns the generation of the snapshot
+  uint32_t read_wire(uint16_t index, uint16_t count, uint8_t *dest) const;
+  uint32_t generation() const { return this->generation_.load(std::memory_order_acquire); }
+
+  // Writers: only inside a WriteSection
+  void set(uint16_t index, uint16_t value) {
+    uint8_t hi = value >> 8;
+    uint8_t lo = value & 0xFF;
+    if (this->bytes_[index * 2] == hi && this->bytes_[index * 2 + 1] == lo)
+      return;
+    this->bytes_[index * 2] = hi;
+    this->bytes_[index * 2 + 1] = lo;
+    this->bump_generation_();
+  }
+  // Store count registers that are already in wire order (FC16 payload)
+  void set_wire(uint16_t index, const uint8_t *src, uint16_t count) {
+    if (memcmp(&this->bytes_[index * 2], src, count * 2) == 0)
+      return;
+    memcpy(&this->bytes_[index * 2], src, count * 2);
+    this->bump_generation_();
+  }
+
+ protected:
+  void begin_write_();
+  void end_write_();
+  void bump_generation_() {
+    this->generation_.store(this->generation_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  uint8_t bytes_[SIZE * 2];
+  std::atomic<uint32_t> sequence_{0};  // odd while a WriteSection is open
+  std::atomic<uint32_t> generation_{0};
+  std::atomic_flag writer_ = ATOMIC_FLAG_INIT;
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,94 @@
+#include "server_task.h"
+
+#ifdef SUNSPEC_HAS_SERVER_TASK
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+static const char *const TAG = "sunspec_modbus_server";
+
+#ifdef USE_ESP32
+static const uint32_t TASK_STACK_SIZE = 4096;
+static const UBaseType_t TASK_PRIORITY = 5;  // above the loop task, below WiFi/lwIP
+#endif
+
+bool ServerTask::start(ModbusTcpServer *server, ModbusTransport *transport, uint8_t core) {
+  this->server_ = server;
+  this->transport_ = transport;
+  this->running_.store(true, std::memory_order_release);
+#ifdef USE_ESP32
+#if portNUM_PROCESSORS > 1
+  BaseType_t affinity = core;
+#else
+  BaseType_t affinity = tskNO_AFFINITY;
+#endif
+  auto entry = [](void *arg) {
+    static_cast<ServerTask *>(arg)->run_();
+    vTaskDelete(nullptr);
+  };
+  if (xTaskCreatePinnedToCore(entry, "modbus_tcp", TASK_STACK_SIZE, this, TASK_PRIORITY, &this->handle_, affinity) !=
+      pdPASS) {
+    this->running_.store(false, std::memory_order_release);
+    return false;
+  }
+#else
+  this->thread_ = std::thread(&ServerTask::run_, this);
+#endif
+  return true;
+}
+
+void ServerTask::stop() {
+  this->running_.store(false, std::memory_order_release);
+#ifndef USE_ESP32
+  if (this->thread_.joinable())
+    this->thread_.join();
+#endif
+}
+
+void ServerTask::run_() {
+  ESP_LOGI(TAG, "Modbus server task started");
+  while (this->running_.load(std::memory_order_acquire)) {
+    this->server_->loop(millis());
+    if (!this->transport_->wait(WAIT_MS)) {
+#ifdef USE_ESP32
+      vTaskDelay(1);  // WiFiServer cannot block on socket activity
+#endif
+    }
+  }
+}
+
+void ServerTask::on_registers_written(uint8_t device, uint16_t reg_start, uint16_t reg_count, uint32_t received_us) {
+  if (!this->writes_.push(WriteEvent{device, reg_start, reg_count, received_us}))
+    this->writes_overflowed_.fetch_or(1UL << device, std::memory_order_release);
+}
+
+void ServerTask::on_request_latency(uint32_t us) {
+  // A full queue only loses a sample
+  this->latencies_.push(us);
+}
+
+void ServerTask::drain(ServerListener *target) {
+  WriteEvent event;
+  while (this->writes_.pop(event))
+    target->on_registers_written(event.device, event.reg_start, event.reg_count, event.received_us);
+  uint32_t overflowed = this->writes_overflowed_.exchange(0, std::memory_order_acq_rel);
+  if (overflowed != 0) {
+    ESP_LOGW(TAG, "Control write queue overflowed — re-evaluating all registers");
+    for (uint8_t device = 0; device < MAX_DEVICES; device++) {
+      if (overflowed & (1UL << device))
+        target->on_registers_written(device, 0, RegisterImage::SIZE, micros());
+    }
+  }
+
+  uint32_t us;
+  while (this->latencies_.pop(us))
+    target->on_request_latency(us);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // SUNSPEC_HAS_SERVER_TASK
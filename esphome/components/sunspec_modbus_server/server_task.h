@@ -0,0 +1,75 @@
+#pragma once
+
+#if defined(USE_ESP32) || defined(__linux__)
+#define SUNSPEC_HAS_SERVER_TASK
+
+#include "modbus_tcp_server.h"
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef USE_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Runs ModbusTcpServer::loop() on its own FreeRTOS task (ESP32) or std::thread
+// (Linux host), so response latency no longer depends on the ESPHome main loop.
+//
+// Nothing is shared by locking:
+//  - main loop → server: register updates go through the seqlock in RegisterImage
+//  - server → main loop: control writes and latency samples are queued here as
+//    the server's listener and replayed by drain() on the main loop
+class ServerTask : public ServerListener {
+ public:
+  // Start serving; server must already be begun. core is ignored on single-core chips and Linux.
+  bool start(ModbusTcpServer *server, ModbusTransport *transport, uint8_t core);
+  void stop();
+  ~ServerTask() { this->stop(); }
+  bool is_running() const { return this->running_.load(std::memory_order_acquire); }
+
+  // Main loop: deliver queued events to target
+  void drain(ServerListener *target);
+
+  // Called on the server task
+  void on_registers_written(uint8_t device, uint16_t reg_start, uint16_t reg_count, uint32_t received_us) override;
+  void on_request_latency(uint32_t us) override;
+
+ protected:
+  struct WriteEvent {
+    uint8_t device;
+    uint16_t reg_start;
+    uint16_t reg_count;
+    uint32_t received_us;
+  };
+
+  static const uint32_t WAIT_MS = 10;  // max idle wait when the transport can block
+
+  void run_();
+
+  ModbusTcpServer *server_{nullptr};
+  ModbusTransport *transport_{nullptr};
+  std::atomic<bool> running_{false};
+  SpscQueue<WriteEvent, 16> writes_;
+  SpscQueue<uint32_t, 64> latencies_;
+  // Devices with a write that did not fit in the queue (bit per device); drain()
+  // then re-evaluates all of their registers
+  std::atomic<uint32_t> writes_overflowed_{0};
+  static_assert(MAX_DEVICES <= 32, "writes_overflowed_ has one bit per device");
+#ifdef USE_ESP32
+  TaskHandle_t handle_{nullptr};
+#else
+  std::thread thread_;
+#endif
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // USE_ESP32 || __linux__
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Fixed-size lock-free queue for exactly one producer task and one consumer task.
+// N must be a power of two; push() fails instead of blocking when the queue is full.
+template<typename T, uint16_t N> class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+  static_assert(N <= 32768, "SpscQueue indices are 16-bit");
+
+ public:
+  bool push(const T &item) {
+    uint16_t head = this->head_.load(std::memory_order_relaxed);
+    uint16_t tail = this->tail_.load(std::memory_order_acquire);
+    if ((uint16_t) (head - tail) == N)
+      return false;
+    this->items_[head & (N - 1)] = item;
+    this->head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint16_t tail = this->tail_.load(std::memory_order_relaxed);
+    uint16_t head = this->head_.load(std::memory_order_acquire);
+    if (head == tail)
+      return false;
+    item = this->items_[tail & (N - 1)];
+    this->tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+ protected:
+  T items_[N];
+  std::atomic<uint16_t> head_{0};  // written by the producer only
+  std::atomic<uint16_t> tail_{0};  // written by the consumer only
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Optional models, selected from YAML (model_120 / model_160) through build flags.
+// Both default on so a build without the flags gets the full Victron-compatible chain.
+#ifndef SUNSPEC_MODEL_120
+#define SUNSPEC_MODEL_120 1
+#endif
+#ifndef SUNSPEC_MODEL_160
+#define SUNSPEC_MODEL_160 1
+#endif
+
+// SunSpec model chain in register order. Every offset below is derived from this
+// list at compile time, so adding or dropping a model only touches this table.
+struct SunSpecModel {
+  uint16_t id;
+  uint16_t length;  // data registers, excluding the 2-register ID/length header
+};
+
+static constexpr SunSpecModel MODEL_CHAIN[] = {
+    {1, 65},  // Common
+#if SUNSPEC_MODEL_120
+    {120, 26},  // Nameplate Ratings
+#endif
+    {103, 50},  // Three-phase inverter
+#if SUNSPEC_MODEL_160
+    {160, 48},  // Multiple MPPT — 8 global + 2 trackers * 20
+#endif
+    {123, 24},  // Immediate Controls
+};
+
+static constexpr uint16_t SUNSPEC_HEADER_LENGTH = 2;  // "SunS" marker
+static constexpr uint16_t MODEL_HEADER_LENGTH = 2;    // ID + length
+
+// Register offset of a model's ID field, or of the end marker if the model is not in the chain
+constexpr uint16_t model_id_offset(uint16_t id) {
+  uint16_t offset = SUNSPEC_HEADER_LENGTH;
+  for (const SunSpecModel &model : MODEL_CHAIN) {
+    if (model.id == id)
+      return offset;
+    offset += MODEL_HEADER_LENGTH + model.length;
+  }
+  return offset;
+}
+
+constexpr uint16_t model_length(uint16_t id) {
+  for (const SunSpecModel &model : MODEL_CHAIN) {
+    if (model.id == id)
+      return model.length;
+  }
+  return 0;
+}
+
+constexpr bool model_enabled(uint16_t id) {
+  for (const SunSpecModel &model : MODEL_CHAIN) {
+    if (model.id == id)
+      return true;
+  }
+  return false;
+}
+
+// SunSpec register layout constants
+static constexpr uint16_t SUNSPEC_BASE_ADDRESS = 40000;
+static constexpr uint16_t SUNSPEC_ID_OFFSET = 0;
+
+static constexpr uint16_t MODEL1_ID_OFFSET = model_id_offset(1);
+static constexpr uint16_t MODEL1_LENGTH_OFFSET = MODEL1_ID_OFFSET + 1;
+static constexpr uint16_t MODEL1_DATA_OFFSET = MODEL1_ID_OFFSET + MODEL_HEADER_LENGTH;
+static constexpr uint16_t MODEL1_LENGTH = model_length(1);
+
+// Model 120 (Nameplate Ratings) — between Model 1 and Model 103
+#if SUNSPEC_MODEL_120
+static constexpr uint16_t MODEL120_ID_OFFSET = model_id_offset(120);
+static constexpr uint16_t MODEL120_LENGTH_OFFSET = MODEL120_ID_OFFSET + 1;
+static constexpr uint16_t MODEL120_DATA_OFFSET = MODEL120_ID_OFFSET + MODEL_HEADER_LENGTH;
+static constexpr uint16_t MODEL120_LENGTH = model_length(120);
+#endif
+
+static constexpr uint16_t MODEL103_ID_OFFSET = model_id_offset(103);
+static constexpr uint16_t MODEL103_LENGTH_OFFSET = MODEL103_ID_OFFSET + 1;
+static constexpr uint16_t MODEL103_DATA_OFFSET = MODEL103_ID_OFFSET + MODEL_HEADER_LENGTH;
+static constexpr uint16_t MODEL103_LENGTH = model_length(103);
+
+// Model 160 (Multiple MPPT)
+#if SUNSPEC_MODEL_160
+static constexpr uint16_t MODEL160_ID_OFFSET = model_id_offset(160);
+static constexpr uint16_t MODEL160_LENGTH_OFFSET = MODEL160_ID_OFFSET + 1;
+static constexpr uint16_t MODEL160_DATA_OFFSET = MODEL160_ID_OFFSET + MODEL_HEADER_LENGTH;
+static constexpr uint16_t MODEL160_LENGTH = model_length(160);
+static constexpr uint16_t MODEL160_TRACKER_BASE = 8;     // data offset of first tracker block
+static constexpr uint16_t MODEL160_TRACKER_STRIDE = 20;  // registers per tracker block
+static constexpr uint16_t MODEL160_TRACKERS = 2;
+#endif
+
+// Model 123 (Immediate Controls)
+static constexpr uint16_t MODEL123_ID_OFFSET = model_id_offset(123);
+static constexpr uint16_t MODEL123_LENGTH_OFFSET = MODEL123_ID_OFFSET + 1;
+static constexpr uint16_t MODEL123_DATA_OFFSET = MODEL123_ID_OFFSET + MODEL_HEADER_LENGTH;
+static constexpr uint16_t MODEL123_LENGTH = model_length(123);
+
+// End marker (0xFFFF, 0) and total
+static constexpr uint16_t END_MODEL_OFFSET = model_id_offset(0xFFFF);
+static constexpr uint16_t TOTAL_REGISTERS = END_MODEL_OFFSET + MODEL_HEADER_LENGTH;
+
+// Read-only diagnostic block (server counters, see ServerCounter) directly after the
+// end marker. It is outside the discovery chain, so SunSpec clients never walk into it.
+static constexpr uint16_t DIAG_OFFSET = TOTAL_REGISTERS;
+
+static_assert(MODEL1_ID_OFFSET == SUNSPEC_HEADER_LENGTH, "Model 1 must directly follow the SunS marker");
+static_assert(model_enabled(1) && model_enabled(103) && model_enabled(123),
+              "Models 1, 103 and 123 are required by the GX");
+static_assert(MODEL103_ID_OFFSET < MODEL123_ID_OFFSET, "Model 123 must follow Model 103");
+#if SUNSPEC_MODEL_160
+static_assert(MODEL160_TRACKER_BASE + MODEL160_TRACKERS * MODEL160_TRACKER_STRIDE == MODEL160_LENGTH,
+              "Model 160 length must match its tracker blocks");
+#endif
+#if SUNSPEC_MODEL_120 && SUNSPEC_MODEL_160
+static_assert(TOTAL_REGISTERS == 227, "full chain layout changed");
+#endif
+
+// Model 1 string fields (relative to MODEL1_DATA_OFFSET), NUL padded
+namespace Model1 {
+  static const uint8_t Mn = 0;   // Manufacturer (16 registers)
+  static const uint8_t Md = 16;  // Model (16 registers)
+  static const uint8_t Opt = 32; // Options (8 registers)
+  static const uint8_t Vr = 40;  // Version (8 registers)
+  static const uint8_t SN = 48;  // Serial number (16 registers)
+  static const uint8_t DA = 64;  // Device address
+}  // namespace Model1
+
+// Model 120 register offsets (relative to MODEL120_DATA_OFFSET)
+namespace Model120 {
+  static const uint8_t DERTyp = 0;       // DER type (4 = PV)
+  static const uint8_t WRtg = 1;         // Continuous power rating (W)
+  static const uint8_t WRtg_SF = 2;      // Scale factor
+  static const uint8_t VARtg = 3;        // Continuous VA rating
+  static const uint8_t VARtg_SF = 4;     // Scale factor
+  static const uint8_t VArRtgQ1 = 5;     // VAr capability Q1
+  static const uint8_t VArRtgQ2 = 6;     // VAr capability Q2
+  static const uint8_t VArRtgQ3 = 7;     // VAr capability Q3
+  static const uint8_t VArRtgQ4 = 8;     // VAr capability Q4
+  static const uint8_t VArRtg_SF = 9;    // Scale factor
+  static const uint8_t ARtg = 10;        // Max RMS AC current (sum of phases)
+  static const uint8_t ARtg_SF = 11;     // Scale factor
+  static const uint8_t PFRtgQ1 = 12;     // Min power factor Q1
+  static const uint8_t PFRtgQ2 = 13;     // Min power factor Q2
+  static const uint8_t PFRtgQ3 = 14;     // Min power factor Q3
+  static const uint8_t PFRtgQ4 = 15;     // Min power factor Q4
+  static const uint8_t PFRtg_SF = 16;    // Scale factor
+  // 17-25: optional storage fields + pad (left as 0)
+}  // namespace Model120
+
+// Model 103 register offsets (relative to MODEL103_DATA_OFFSET)
+namespace Model103 {
+  static const uint8_t A = 0;        // AC Total Current
+  static const uint8_t AphA = 1;     // Phase A Current
+  static const uint8_t AphB = 2;     // Phase B Current
+  static const uint8_t AphC = 3;     // Phase C Current
+  static const uint8_t A_SF = 4;     // Current Scale Factor
+  static const uint8_t PPVphAB = 5;  // Phase AB Voltage
+  static const uint8_t PPVphBC = 6;  // Phase BC Voltage
+  static const uint8_t PPVphCA = 7;  // Phase CA Voltage
+  static const uint8_t PhVphA = 8;   // Phase A Voltage
+  static const uint8_t PhVphB = 9;   // Phase B Voltage
+  static const uint8_t PhVphC = 10;  // Phase C Voltage
+  static const uint8_t V_SF = 11;    // Voltage Scale Factor
+  static const uint8_t W = 12;       // AC Power
+  static const uint8_t W_SF = 13;    // Power Scale Factor
+  static const uint8_t Hz = 14;      // Frequency
+  static const uint8_t Hz_SF = 15;   // Frequency Scale Factor
+  static const uint8_t VA = 16;      // Apparent Power
+  static const uint8_t VA_SF = 17;   // VA Scale Factor
+  static const uint8_t VAr = 18;     // Reactive Power
+  static const uint8_t VAr_SF = 19;  // VAr Scale Factor
+  static const uint8_t PF = 20;      // Power Factor
+  static const uint8_t PF_SF = 21;   // PF Scale Factor
+  static const uint8_t WH_HI = 22;   // Energy High Word
+  static const uint8_t WH_LO = 23;   // Energy Low Word
+  static const uint8_t WH_SF = 24;   // Energy Scale Factor
+  static const uint8_t DCA = 25;     // DC Current
+  static const uint8_t DCA_SF = 26;  // DC Current SF
+  static const uint8_t DCV = 27;     // DC Voltage
+  static const uint8_t DCV_SF = 28;  // DC Voltage SF
+  static const uint8_t DCW = 29;     // DC Power
+  static const uint8_t DCW_SF = 30;  // DC Power SF
+  static const uint8_t TmpCab = 31;  // Cabinet Temperature
+  static const uint8_t TmpSnk = 32;  // Heat Sink Temperature
+  static const uint8_t TmpTrns = 33; // Transformer Temperature
+  static const uint8_t TmpOt = 34;   // Other Temperature
+  static const uint8_t Tmp_SF = 35;  // Temperature Scale Factor
+  static const uint8_t St = 36;      // Operating State
+  static const uint8_t StVnd = 37;   // Vendor Operating State
+}  // namespace Model103
+
+// Model 160 register offsets (relative to MODEL160_DATA_OFFSET)
+namespace Model160 {
+  static const uint8_t DCA_SF  = 0;   // Current scale factor (all trackers)
+  static const uint8_t DCV_SF  = 1;   // Voltage scale factor
+  static const uint8_t DCW_SF  = 2;   // Power scale factor
+  static const uint8_t DCWH_SF = 3;   // Energy scale factor
+  static const uint8_t Evt1    = 4;   // Global events (high word)
+  static const uint8_t Evt2    = 5;   // Global events (low word)
+  static const uint8_t N       = 6;   // Number of trackers
+  static const uint8_t TmsPer  = 7;   // Timestamp period
+  // Per-tracker block offsets (from start of tracker block, 20 regs each)
+  static const uint8_t T_ID    = 0;   // Tracker input ID
+  // T_IDStr occupies offsets 1-8 (8 registers)
+  static const uint8_t T_DCA   = 9;   // DC current
+  static const uint8_t T_DCV   = 10;  // DC voltage  ← Victron reads this
+  static const uint8_t T_DCW   = 11;  // DC power    ← Victron reads this
+}  // namespace Model160
+
+// Model 123 register offsets (relative to MODEL123_DATA_OFFSET)
+namespace Model123 {
+  // Connection controls (3 registers before power limit fields)
+  static const uint8_t Conn_WinTms = 0;        // Time to connect (s)
+  static const uint8_t Conn_RvrtTms = 1;       // Time to revert connection (s)
+  static const uint8_t Conn = 2;               // Connect/disconnect (1=connect)
+  // Power limit controls — Victron writes at immediateControlOffset+5 = data[3]
+  static const uint8_t WMaxLimPct = 3;         // Max power output %
+  static const uint8_t WMaxLimPct_WinTms = 4;
+  static const uint8_t WMaxLimPct_RvrtTms = 5;
+  static const uint8_t WMaxLimPct_RmpTms = 6;
+  static const uint8_t WMaxLim_Ena = 7;        // 0=disabled, 1=enabled
+  static const uint8_t OutPFSet = 8;
+  static const uint8_t OutPFSet_WinTms = 9;
+  static const uint8_t OutPFSet_RvrtTms = 10;
+  static const uint8_t OutPFSet_RmpTms = 11;
+  static const uint8_t OutPFSet_Ena = 12;
+  static const uint8_t VArPct_Mod = 13;
+  static const uint8_t VArPct_WinTms = 14;
+  static const uint8_t VArPct_RvrtTms = 15;
+  static const uint8_t VArPct_RmpTms = 16;
+  static const uint8_t VArSetPct = 17;
+  static const uint8_t VArSetPct_Ena = 18;
+  static const uint8_t WMaxLimPct_SF = 19;     // Scale factor (we set to 0)
+  static const uint8_t OutPFSet_SF = 20;
+  // 21-23: padding
+}  // namespace Model123
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
@@ -1,538 +1,707 @@
 #include "sunspec_server.h"
 #include "esphome/core/log.h"
 #include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "alloc_check.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
 
+#if defined(USE_ESP32)
+#include <esp_heap_caps.h>
+#elif defined(USE_ESP8266)
+#include <Esp.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
 namespace esphome {
 namespace sunspec_modbus_server {
 
 static const char *const TAG = "sunspec_modbus_server";
 
-// Modbus function codes
-static const uint8_t FC_READ_HOLDING_REGISTERS = 0x03;
-static const uint8_t FC_READ_INPUT_REGISTERS = 0x04;
-static const uint8_t FC_WRITE_SINGLE_REGISTER = 0x06;
-static const uint8_t FC_WRITE_MULTIPLE_REGISTERS = 0x10;
+static constexpr uint16_t NO_REGISTER = 0xFFFF;
+static constexpr float U16_MAX = 65535.0f;
+static constexpr float U32_MAX = 4294967040.0f;  // largest float below 2^32
+// Shortest gap between two control state writes, even for enable/disable changes
+static constexpr uint32_t PERSIST_MIN_INTERVAL = 5000;
+// Closed loop: smaller trims (percent) are not worth an RTU write
+static constexpr float CLOSED_LOOP_MIN_STEP = 0.5f;
+// A curtailment that has not reached its limit by then is reported and dropped
+static constexpr uint32_t CONTROL_TRACE_TIMEOUT_US = 60000000;
+static_assert(CONTROL_TRACE_TIMEOUT_US < LatencyHistogram::RANGE_US,
+              "control_settle/control_total percentiles must resolve up to the trace timeout");
+
+// Model 160 tracker register, or NO_REGISTER when the model is not served
+static constexpr uint16_t tracker_register(uint8_t tracker, uint8_t reg) {
+#if SUNSPEC_MODEL_160
+  return MODEL160_DATA_OFFSET + MODEL160_TRACKER_BASE + tracker * MODEL160_TRACKER_STRIDE + reg;
+#else
+  return NO_REGISTER;
+#endif
+}
 
-// Modbus exception codes
-static const uint8_t EX_ILLEGAL_FUNCTION = 0x01;
-static const uint8_t EX_ILLEGAL_DATA_ADDRESS = 0x02;
-static const uint8_t EX_ILLEGAL_DATA_VALUE = 0x03;
-static const uint8_t EX_SERVER_DEVICE_FAILURE = 0x04;
+// How a ValueField is served: register (plus an optional second register carrying the
+// same value), multiplier into register units (the model's scale factor), clamp range in
+// register units, register count (2 = uint32, high word first), and the value served
+// before the first source state.
+struct FieldEncoding {
+  ValueField field;
+  uint16_t reg;
+  uint16_t mirror;
+  float scale;
+  float min;
+  float max;
+  uint8_t registers;
+  float initial;
+};
+
+static constexpr uint16_t M103 = MODEL103_DATA_OFFSET;
+
+static constexpr FieldEncoding FIELD_ENCODINGS[FIELD_COUNT] = {
+    {FIELD_AC_POWER, M103 + Model103::W, NO_REGISTER, 1, 0, U16_MAX, 1, 0},
+    {FIELD_AC_VOLTAGE_A, M103 + Model103::PhVphA, NO_REGISTER, 10, 0, U16_MAX, 1, 230.0f},
+    {FIELD_AC_VOLTAGE_B, M103 + Model103::PhVphB, NO_REGISTER, 10, 0, U16_MAX, 1, 230.0f},
+    {FIELD_AC_VOLTAGE_C, M103 + Model103::PhVphC, NO_REGISTER, 10, 0, U16_MAX, 1, 230.0f},
+    {FIELD_LINE_VOLTAGE_AB, M103 + Model103::PPVphAB, NO_REGISTER, 10, 0, U16_MAX, 1, 398.0f},
+    {FIELD_LINE_VOLTAGE_BC, M103 + Model103::PPVphBC, NO_REGISTER, 10, 0, U16_MAX, 1, 398.0f},
+    {FIELD_LINE_VOLTAGE_CA, M103 + Model103::PPVphCA, NO_REGISTER, 10, 0, U16_MAX, 1, 398.0f},
+    {FIELD_AC_CURRENT_TOTAL, M103 + Model103::A, NO_REGISTER, 100, 0, U16_MAX, 1, 0},
+    {FIELD_AC_CURRENT_A, M103 + Model103::AphA, NO_REGISTER, 100, 0, U16_MAX, 1, 0},
+    {FIELD_AC_CURRENT_B, M103 + Model103::AphB, NO_REGISTER, 100, 0, U16_MAX, 1, 0},
+    {FIELD_AC_CURRENT_C, M103 + Model103::AphC, NO_REGISTER, 100, 0, U16_MAX, 1, 0},
+    {FIELD_FREQUENCY, M103 + Model103::Hz, NO_REGISTER, 100, 0, U16_MAX, 1, 50.0f},
+    {FIELD_POWER_FACTOR, M103 + Model103::PF, NO_REGISTER, 100, -100, 100, 1, 0.99f},
+    {FIELD_APPARENT_POWER, M103 + Model103::VA, NO_REGISTER, 1, 0, U16_MAX, 1, 0},
+    {FIELD_REACTIVE_POWER, M103 + Model103::VAr, NO_REGISTER, 1, 0, U16_MAX, 1, 0},
+    {FIELD_TOTAL_ENERGY, M103 + Model103::WH_HI, NO_REGISTER, 1, 0, U32_MAX, 2, 0},
+    // PV1 is served as Model 103 DC and Model 160 tracker 0
+    {FIELD_DC_VOLTAGE, M103 + Model103::DCV, tracker_register(0, Model160::T_DCV), 10, 0, U16_MAX, 1, 450.0f},
+    {FIELD_DC_CURRENT, M103 + Model103::DCA, tracker_register(0, Model160::T_DCA), 100, 0, U16_MAX, 1, 0},
+    {FIELD_DC_POWER, M103 + Model103::DCW, tracker_register(0, Model160::T_DCW), 1, 0, U16_MAX, 1, 0},
+    {FIELD_TEMPERATURE, M103 + Model103::TmpCab, M103 + Model103::TmpSnk, 1, -32768, 32767, 1, 35.0f},
+    {FIELD_STATE, M103 + Model103::St, NO_REGISTER, 1, 0, U16_MAX, 1, (float) InverterState::MPPT},
+    {FIELD_PV2_VOLTAGE, tracker_register(1, Model160::T_DCV), NO_REGISTER, 10, 0, U16_MAX, 1, 0},
+    {FIELD_PV2_CURRENT, tracker_register(1, Model160::T_DCA), NO_REGISTER, 100, 0, U16_MAX, 1, 0},
+    {FIELD_PV2_POWER, tracker_register(1, Model160::T_DCW), NO_REGISTER, 1, 0, U16_MAX, 1, 0},
+    {FIELD_INVERTER_STATUS, NO_REGISTER, NO_REGISTER, 1, 0, U16_MAX, 1, 0},
+};
+
+static constexpr bool encodings_in_field_order() {
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    if (FIELD_ENCODINGS[i].field != i)
+      return false;
+  }
+  return true;
+}
+static_assert(encodings_in_field_order(), "FIELD_ENCODINGS must list every ValueField in enum order");
 
-// Modbus TCP header size (MBAP)
-static const size_t MBAP_HEADER_SIZE = 7;
-static const size_t MIN_REQUEST_SIZE = 12;  // MBAP + Unit ID + FC + Start Addr + Quantity
+// Read demand chunks holding a field's registers
+static constexpr uint32_t chunk_bits(uint16_t reg, uint8_t registers) {
+  return reg == NO_REGISTER ? 0 : (1UL << (reg / DEMAND_CHUNK)) | (1UL << ((reg + registers - 1) / DEMAND_CHUNK));
+}
+static constexpr uint32_t field_chunks(const FieldEncoding &enc) {
+  return chunk_bits(enc.reg, enc.registers) | chunk_bits(enc.mirror, enc.registers);
+}
 
-// Clamp a float to a valid uint16_t register value.
-// Returns 0 for NaN, negative, or subnormal; 65535 for Inf or overflow.
-static inline uint16_t safe_u16(float v) {
-  if (!std::isfinite(v) || v < 0.0f) return 0;
-  if (v > 65535.0f) return 65535;
-  return static_cast<uint16_t>(v);
+// Value → register units: scaled and clamped to the field's range; 0 for NaN or Inf.
+// Negative values come back as their two's complement (int16 registers keep the low word).
+static inline uint32_t encode(ValueField field, float value) {
+  const FieldEncoding &enc = FIELD_ENCODINGS[field];
+  float v = value * enc.scale;
+  if (!std::isfinite(v))
+    return 0;
+  v = std::max(enc.min, std::min(enc.max, v));
+  return v < 0.0f ? (uint32_t) (int32_t) v : (uint32_t) v;
 }
 
 SunSpecModbusServer::SunSpecModbusServer() {
-  memset(this->registers_, 0, sizeof(this->registers_));
+  for (const FieldEncoding &enc : FIELD_ENCODINGS)
+    this->values_[enc.field] = enc.initial;
 }
 
 void SunSpecModbusServer::setup() {
   ESP_LOGCONFIG(TAG, "Setting up SunSpec Modbus TCP Server...");
+  this->prepare_();
 
-  // Initialize SunSpec registers with static data
-  this->init_registers_();
+  // Histograms only for an instance that times something (~2.5 KB)
+  if (this->latency_enabled_)
+    this->latency_.reset(new LatencyHistogram[LATENCY_COUNT]);
 
   // Initialize timing
   this->last_update_ = millis();
+  this->last_latency_publish_ = this->last_update_;
+  this->last_history_ = this->last_update_;
 
-  // Start TCP server
-  this->start_server_();
+  // Timestamp source states (and in event-driven mode push them into the registers)
+  this->subscribe_sources_();
+
+  // Start TCP server, unless this device is served by another instance's
+  if (!this->hosted_)
+    this->start_server_();
+}
+
+void SunSpecModbusServer::prepare_() {
+  if (this->prepared_)
+    return;
+  this->prepared_ = true;
+
+  // Initialize SunSpec registers with static data
+  this->init_registers_();
+  if (this->history_size_ > 0)
+    this->history_.init(this->history_size_, this->history_interval_);
+
+  // Put back the limit from before the reboot, so the first request already sees it
+  if (this->restore_state_)
+    this->restore_control_state_();
 }
 
 void SunSpecModbusServer::loop() {
   // Update values from source sensors
   uint32_t now = millis();
+  uint32_t loop_start = this->latency_enabled_ ? micros() : 0;
+  uint32_t mark = loop_start;
   if (now - this->last_update_ >= this->update_interval_) {
-    this->update_from_sources_();
-    this->update_registers_();
+    // In event-driven mode the sources are already in values_; the periodic pass
+    // still re-evaluates the operating state (throttling follows Model 123 writes)
+    {
+      AllocationCheck check("register update");
+      if (this->stale_timeout_ > 0)
+        this->expire_sources_(now);
+      if (!this->event_driven_) {
+        this->update_from_sources_();
+        this->phase_done_(LATENCY_SOURCE_UPDATE, mark);
+      }
+      this->refresh_registers_();
+      this->phase_done_(LATENCY_REGISTER_UPDATE, mark);
+    }
     this->publish_sensors_();
+    this->phase_done_(LATENCY_SENSOR_PUBLISH, mark);
+    if (this->restore_state_)
+      this->persist_state_(now, false);
+
+    // Client reads since the last pass steer the pollers, ours and those of hosted devices
+    if (this->host_ != nullptr) {
+      for (uint8_t i = 0; i < MAX_DEVICES; i++) {
+        SunSpecModbusServer *device = this->devices_[i];
+        if (device != nullptr && !device->pollers_.empty())
+          device->note_demand_(this->host_->server, i, now);
+      }
+    }
+    if (!this->pollers_.empty())
+      this->run_pollers_(now);
     this->last_update_ = now;
   }
 
+  if (this->history_.is_enabled() && now - this->last_history_ >= this->history_interval_) {
+    this->record_history_();
+    this->last_history_ = now;
+  }
+
   // Check revert timer: restore full power if Victron stops sending commands
   if (this->revert_active_ && (now - this->revert_deadline_) < 0x80000000U) {
     this->revert_active_ = false;
-    this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena] = 0;
-    this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct] = 100;
-    if (this->power_limit_number_ != nullptr) {
-      ESP_LOGW(TAG, "Revert timer expired — restoring full power (100%%)");
-      auto call = this->power_limit_number_->make_call();
-      call.set_value(100.0f);
-      call.perform();
+    {
+      RegisterImage::WriteSection section(this->image_);
+      this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena, 0);
+      this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct, 100);
+    }
+    ESP_LOGW(TAG, "Revert timer expired — restoring full power (100%%)");
+    this->actuator_.command(100.0f, 0, now);
+  }
+  this->actuate_power_limit_(now);
+  this->phase_done_(LATENCY_REVERT_CHECK, mark);
+
+  // Handle Modbus TCP clients, or pick up what the server task queued for us
+  if (this->host_ != nullptr) {
+#ifdef SUNSPEC_HAS_SERVER_TASK
+    if (this->host_->task.is_running()) {
+      this->host_->task.drain(this);
+    } else
+#endif
+    {
+      this->host_->server.loop(now);
     }
   }
+  this->phase_done_(LATENCY_CLIENT_HANDLING, mark);
 
-  // Handle Modbus TCP clients
-  this->handle_client_();
+  if (this->latency_enabled_) {
+    this->latency_[LATENCY_LOOP].record(mark - loop_start);
+    if (now - this->last_latency_publish_ >= this->latency_interval_) {
+      this->publish_latency_();
+      this->last_latency_publish_ = now;
+    }
+  }
 }
 
 void SunSpecModbusServer::dump_config() {
   ESP_LOGCONFIG(TAG, "SunSpec Modbus TCP Server:");
-  ESP_LOGCONFIG(TAG, "  Port: %u", this->port_);
+  if (!this->hosted_)
+    ESP_LOGCONFIG(TAG, "  Port: %u", this->port_);
   ESP_LOGCONFIG(TAG, "  Unit ID: %u", this->unit_id_);
-  ESP_LOGCONFIG(TAG, "  Manufacturer: %s", this->manufacturer_.c_str());
-  ESP_LOGCONFIG(TAG, "  Model: %s", this->model_.c_str());
-  ESP_LOGCONFIG(TAG, "  Serial: %s", this->serial_.c_str());
+  ESP_LOGCONFIG(TAG, "  Manufacturer: %s", this->manufacturer_);
+  ESP_LOGCONFIG(TAG, "  Model: %s", this->model_);
+  ESP_LOGCONFIG(TAG, "  Serial: %s", this->serial_);
+  for (const SunSpecModel &model : MODEL_CHAIN) {
+    ESP_LOGCONFIG(TAG, "  Model %u: registers %u-%u", model.id, SUNSPEC_BASE_ADDRESS + model_id_offset(model.id),
+                  SUNSPEC_BASE_ADDRESS + model_id_offset(model.id) + MODEL_HEADER_LENGTH + model.length - 1);
+  }
+  ESP_LOGCONFIG(TAG, "  Diagnostics: registers %u-%u", SUNSPEC_BASE_ADDRESS + DIAG_OFFSET,
+                SUNSPEC_BASE_ADDRESS + DIAG_OFFSET + DIAG_LENGTH - 1);
   ESP_LOGCONFIG(TAG, "  Update Interval: %u ms", this->update_interval_);
+  ESP_LOGCONFIG(TAG, "  Event Driven: %s", YESNO(this->event_driven_));
+  if (this->hosted_) {
+    ESP_LOGCONFIG(TAG, "  Server: shared with another instance");
+  } else {
+    ESP_LOGCONFIG(TAG, "  Devices: %u", 1 + (unsigned) this->peers_.size());
+    ESP_LOGCONFIG(TAG, "  Max Clients: %u", this->max_clients_);
+    ESP_LOGCONFIG(TAG, "  Client Timeout: %u ms", this->client_timeout_);
+    ESP_LOGCONFIG(TAG, "  Dedicated Task: %s", YESNO(this->dedicated_task_));
+#ifdef USE_ESP32
+    if (this->dedicated_task_)
+      ESP_LOGCONFIG(TAG, "  Task Core: %u", this->task_core_);
+#endif
+  }
+  ESP_LOGCONFIG(TAG, "  Power Limit Deadband: %.1f%%", this->actuator_.get_deadband());
+  ESP_LOGCONFIG(TAG, "  Power Limit Interval: %u ms", this->actuator_.get_interval());
+  if (this->controller_.is_enabled()) {
+    ESP_LOGCONFIG(TAG, "  Closed Loop: bandwidth %.3f Hz, response time %.1f s, proportional gain %.2f",
+                  this->controller_.get_bandwidth(), this->controller_.get_response_time(),
+                  this->controller_.get_proportional());
+  }
+  if (this->history_.is_enabled()) {
+    ESP_LOGCONFIG(TAG, "  History: %u bytes, one sample per %u ms, registers %u-%u", (unsigned) this->history_.get_size(),
+                  this->history_.get_interval(), SUNSPEC_BASE_ADDRESS + HISTORY_OFFSET,
+                  SUNSPEC_BASE_ADDRESS + HISTORY_OFFSET + this->history_.window_registers() - 1);
+  }
+  if (this->restore_state_)
+    ESP_LOGCONFIG(TAG, "  Restore State: YES, persist interval %u ms", this->persist_interval_);
+  if (this->stale_timeout_ > 0)
+    ESP_LOGCONFIG(TAG, "  Stale Timeout: %u ms", this->stale_timeout_);
+  for (const SourcePoller &poller : this->pollers_)
+    ESP_LOGCONFIG(TAG, "  Poller: every %u ms while read, %u ms idle", poller.interval, poller.idle_interval);
+  if (this->latency_enabled_)
+    ESP_LOGCONFIG(TAG, "  Latency Interval: %u ms", this->latency_interval_);
 }
 
-void SunSpecModbusServer::start_server_() {
-  this->server_ = new WiFiServer(this->port_);
-  if (!this->server_) {
-    ESP_LOGE(TAG, "Failed to allocate WiFiServer on port %u", this->port_);
-    this->mark_failed();
-    return;
-  }
-  this->server_->begin();
-  ESP_LOGI(TAG, "Modbus TCP server started on port %u", this->port_);
+void SunSpecModbusServer::on_shutdown() {
+  // OTA or reboot: keep the latest state, not the last coalesced one
+  if (this->restore_state_ && this->prepared_)
+    this->persist_state_(millis(), true);
 }
 
-void SunSpecModbusServer::handle_client_() {
-  uint32_t now = millis();
-
-  // Check for new client
-  if (this->server_->hasClient()) {
-    if (this->client_connected_) {
-      // Already have a client, reject new one
-      WiFiClient new_client = this->server_->accept();
-      new_client.stop();
-      ESP_LOGW(TAG, "Rejected new client, already connected");
-    } else {
-      this->client_ = this->server_->accept();
-      this->client_connected_ = true;
-      this->last_rx_ms_ = now;
-      ESP_LOGI(TAG, "Client connected from %s", this->client_.remoteIP().toString().c_str());
+void SunSpecModbusServer::start_server_() {
+  this->host_ = std::make_unique<ServerHost>();
+  ModbusTcpServer &server = this->host_->server;
+  server.set_transport(&this->host_->transport);
+  server.set_listener(this);
+  server.set_max_clients(this->max_clients_);
+  server.set_client_timeout(this->client_timeout_);
+  server.set_request_timing(this->latency_enabled_);
+
+  // This instance is device 0, added devices follow; the server index routes control writes back
+  this->devices_[server.add_device(this->unit_id_, &this->image_, &this->history_)] = this;
+  for (SunSpecModbusServer *device : this->peers_) {
+    device->prepare_();  // its own setup() may run after ours
+    int index = server.add_device(device->unit_id_, &device->image_, &device->history_);
+    if (index == DEVICE_NONE) {
+      ESP_LOGE(TAG, "Cannot serve unit ID %u (already in use or too many devices)", device->unit_id_);
+      device->mark_failed();
+      continue;
     }
+    this->devices_[index] = device;
   }
-
-  // Handle existing client
-  if (this->client_connected_) {
-    // Stale connection timeout: force-close if no data received for CLIENT_TIMEOUT_MS
-    bool timed_out = (now - this->last_rx_ms_) >= CLIENT_TIMEOUT_MS;
-
-    if (!this->client_.connected() || timed_out) {
-      if (timed_out) {
-        ESP_LOGW(TAG, "Client timeout — forcing disconnect");
-      } else {
-        ESP_LOGI(TAG, "Client disconnected");
-      }
-      this->client_.stop();
-      this->client_connected_ = false;
-      return;
-    }
-
-    // Check for incoming data
-    if (this->client_.available() >= MIN_REQUEST_SIZE) {
-      uint8_t buffer[256];
-      size_t len = this->client_.read(buffer, sizeof(buffer));
-      if (len >= MIN_REQUEST_SIZE) {
-        this->last_rx_ms_ = now;
-        this->process_request_(this->client_, buffer, len);
-      }
+  // Control paths of all served devices are timed into our histograms
+  if (this->latency_enabled_) {
+    for (SunSpecModbusServer *device : this->devices_) {
+      if (device != nullptr)
+        device->enable_control_trace_(this->latency_.get(), this->control_tolerance_);
     }
   }
-}
-
-void SunSpecModbusServer::process_request_(WiFiClient &client, uint8_t *buffer, size_t len) {
-  // Parse MBAP header
-  // uint16_t transaction_id = (buffer[0] << 8) | buffer[1];
-  uint16_t protocol_id = (buffer[2] << 8) | buffer[3];
-  // uint16_t length = (buffer[4] << 8) | buffer[5];
-  uint8_t unit_id = buffer[6];
-
-  // Modbus TCP protocol_id must always be 0x0000
-  if (protocol_id != 0) {
-    ESP_LOGW(TAG, "Ignoring non-Modbus frame (protocol_id=0x%04X)", protocol_id);
-    return;
-  }
-  uint8_t function_code = buffer[7];
-  uint16_t start_addr = (buffer[8] << 8) | buffer[9];
-  uint16_t quantity = (buffer[10] << 8) | buffer[11];
-
-  ESP_LOGD(TAG, "Request: Unit=%u, FC=%u, Addr=%u, Qty=%u", unit_id, function_code, start_addr, quantity);
 
-  // Check unit ID
-  if (unit_id != this->unit_id_ && unit_id != 0) {
-    // Ignore requests not for us (don't respond per Modbus spec)
-    ESP_LOGD(TAG, "Ignoring request for unit %u", unit_id);
+  if (!server.begin(this->port_)) {
+    ESP_LOGE(TAG, "Failed to start Modbus TCP server on port %u", this->port_);
+    this->host_.reset();
+    this->mark_failed();
     return;
   }
+  ESP_LOGI(TAG, "Modbus TCP server started on port %u (%u devices)", this->port_, server.get_device_count());
 
-  // Handle function codes
-  switch (function_code) {
-    case FC_READ_HOLDING_REGISTERS:
-    case FC_READ_INPUT_REGISTERS: {
-      // Convert Modbus address to register index
-      uint16_t reg_start;
-      if (start_addr >= SUNSPEC_BASE_ADDRESS) {
-        reg_start = start_addr - SUNSPEC_BASE_ADDRESS;
-      } else {
-        // Some clients use 0-based addressing
-        reg_start = start_addr;
-      }
-
-      // Validate address range
-      if (reg_start + quantity > TOTAL_REGISTERS) {
-        ESP_LOGW(TAG, "Invalid address range: %u + %u > %u", reg_start, quantity, TOTAL_REGISTERS);
-        this->send_error_(client, buffer, EX_ILLEGAL_DATA_ADDRESS);
-        return;
-      }
-
-      // Send response
-      this->send_response_(client, buffer, reg_start, quantity);
-      break;
+#ifdef SUNSPEC_HAS_SERVER_TASK
+  if (this->dedicated_task_) {
+    // From here on only the task touches the server; its events reach us through drain()
+    server.set_listener(&this->host_->task);
+    if (!this->host_->task.start(&server, &this->host_->transport, this->task_core_)) {
+      ESP_LOGW(TAG, "Failed to start Modbus server task — serving from the main loop");
+      server.set_listener(this);
     }
-    case FC_WRITE_SINGLE_REGISTER: {
-      this->handle_write_single_(client, buffer);
-      break;
-    }
-    case FC_WRITE_MULTIPLE_REGISTERS: {
-      this->handle_write_multiple_(client, buffer, len);
-      break;
-    }
-    default:
-      ESP_LOGW(TAG, "Unsupported function code: %u", function_code);
-      this->send_error_(client, buffer, EX_ILLEGAL_FUNCTION);
-      break;
   }
+#endif
 }
 
-void SunSpecModbusServer::send_response_(WiFiClient &client, uint8_t *request, uint16_t start_addr, uint16_t reg_count) {
-  // Build response — Modbus FC03 max is 125 registers (250 bytes data + 9 header = 259 bytes)
-  static const uint16_t MAX_REGISTERS_PER_READ = 125;
-  if (reg_count > MAX_REGISTERS_PER_READ) reg_count = MAX_REGISTERS_PER_READ;
-  uint8_t response[9 + MAX_REGISTERS_PER_READ * 2];
-  size_t response_len = MBAP_HEADER_SIZE + 2 + (reg_count * 2);
-
-  // Copy MBAP header (transaction ID, protocol ID)
-  memcpy(response, request, 4);
-
-  // Length field (unit ID + function code + byte count + data)
-  uint16_t length = 3 + (reg_count * 2);
-  response[4] = length >> 8;
-  response[5] = length & 0xFF;
-
-  // Unit ID
-  response[6] = request[6];
-
-  // Function code (same as request)
-  response[7] = request[7];
-
-  // Byte count
-  response[8] = reg_count * 2;
-
-  // Register data (big-endian)
-  for (uint16_t i = 0; i < reg_count; i++) {
-    uint16_t reg_value = this->registers_[start_addr + i];
-    response[9 + (i * 2)] = reg_value >> 8;
-    response[9 + (i * 2) + 1] = reg_value & 0xFF;
-  }
-
-  client.write(response, response_len);
-  ESP_LOGD(TAG, "Sent %u registers starting at %u", reg_count, start_addr);
+void SunSpecModbusServer::on_registers_written(uint8_t device, uint16_t reg_start, uint16_t reg_count,
+                                               uint32_t received_us) {
+  SunSpecModbusServer *target = this->devices_[device];
+  if (target->handle_control_write_(reg_start, reg_count))
+    target->start_control_trace_(received_us);
 }
 
-void SunSpecModbusServer::send_error_(WiFiClient &client, uint8_t *request, uint8_t error_code) {
-  uint8_t response[9];
-
-  // Copy MBAP header
-  memcpy(response, request, 4);
-
-  // Length field
-  response[4] = 0;
-  response[5] = 3;
+bool SunSpecModbusServer::handle_control_write_(uint16_t reg_start, uint16_t reg_count) {
+  // Check if any Model 123 registers were touched
+  if (reg_start + reg_count <= MODEL123_DATA_OFFSET) return false;
+  if (reg_start >= MODEL123_DATA_OFFSET + MODEL123_LENGTH) return false;
 
-  // Unit ID
-  response[6] = request[6];
+  // Model 123 WMaxLimPct / WMaxLim_Ena control
+  uint16_t ena = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena);
+  uint16_t pct_raw = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct);
+  uint16_t rvrt_tms = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RvrtTms);
+  uint16_t rmp_tms = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RmpTms);
+  int16_t sf = (int16_t)this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_SF);
 
-  // Function code with error bit set
-  response[7] = request[7] | 0x80;
+  // Apply scale factor: value * 10^sf
+  float pct;
+  if (sf == 0) {
+    pct = (float)pct_raw;
+  } else {
+    pct = (float)pct_raw * powf(10.0f, (float)sf);
+  }
+  if (pct < 0.0f) pct = 0.0f;
+  if (pct > 100.0f) pct = 100.0f;
 
-  // Exception code
-  response[8] = error_code;
+  // Arm or disarm the revert timer
+  if (ena == 1 && rvrt_tms > 0) {
+    this->revert_active_ = true;
+    this->revert_deadline_ = millis() + ((uint32_t)rvrt_tms * 1000);
+    ESP_LOGD(TAG, "Revert timer armed: %u seconds", rvrt_tms);
+  } else {
+    this->revert_active_ = false;
+  }
 
-  client.write(response, 9);
-  ESP_LOGD(TAG, "Sent error response: %u", error_code);
+  // Hand the target to the actuator; loop() performs the (deduplicated, rate-limited,
+  // ramped) downstream writes
+  float target = (ena == 1) ? pct : 100.0f;  // Disabled = restore full power
+  ESP_LOGD(TAG, "Model123: WMaxLim_Ena=%u WMaxLimPct=%.1f%% RmpTms=%u", ena, pct, rmp_tms);
+  return this->actuator_.command(target, (uint32_t) rmp_tms * 1000, millis());
 }
 
-void SunSpecModbusServer::handle_write_single_(WiFiClient &client, uint8_t *buffer) {
-  uint16_t reg_addr = (buffer[8] << 8) | buffer[9];
-  uint16_t value = (buffer[10] << 8) | buffer[11];
-
-  // Convert to internal index
-  uint16_t reg_idx = (reg_addr >= SUNSPEC_BASE_ADDRESS) ? reg_addr - SUNSPEC_BASE_ADDRESS : reg_addr;
-
-  if (reg_idx >= TOTAL_REGISTERS) {
-    this->send_error_(client, buffer, EX_ILLEGAL_DATA_ADDRESS);
+void SunSpecModbusServer::restore_control_state_() {
+  // Keyed per device; a layout change starts from defaults instead of misreading old data
+  char key[64];
+  snprintf(key, sizeof(key), "sunspec_modbus_server_%s_%u_v%u", this->serial_, this->unit_id_,
+           (unsigned) PERSISTED_STATE_VERSION);
+  uint32_t hash = fnv1_hash(key);
+  this->pref_ = global_preferences->make_preference<PersistedState>(hash);
+  this->last_persist_ = millis();
+
+  PersistedState state;
+  if (!this->pref_.load(&state)) {
+    this->saved_state_ = this->capture_state_();
+    ESP_LOGD(TAG, "No saved control state");
     return;
   }
+  this->saved_state_ = state;
+  {
+    RegisterImage::WriteSection section(this->image_);
+    this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct, state.wmaxlim_pct);
+    this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena, state.wmaxlim_ena);
+    this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RvrtTms, state.rvrt_tms);
+    this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RmpTms, state.rmp_tms);
+  }
+  // Until the energy source reports, WH continues from the saved count instead of 0
+  this->store_(FIELD_TOTAL_ENERGY, (float) state.energy);
+  this->update_registers_();
+
+  ESP_LOGI(TAG, "Restored control state: WMaxLim_Ena=%u WMaxLimPct=%u RvrtTms=%u, energy %u Wh", state.wmaxlim_ena,
+           state.wmaxlim_pct, state.rvrt_tms, (unsigned) state.energy);
+  // Same path as a GX write: commands the actuator (the first loop() writes the limit out)
+  // and restarts the revert timer with the full RvrtTms
+  this->handle_control_write_(MODEL123_DATA_OFFSET, MODEL123_LENGTH);
+}
 
-  this->registers_[reg_idx] = value;
-  this->process_write_(reg_idx, 1);
-
-  // Echo the request as response (FC06 standard)
-  client.write(buffer, 12);
-  ESP_LOGD(TAG, "Write single reg %u = %u", reg_idx, value);
+PersistedState SunSpecModbusServer::capture_state_() const {
+  PersistedState state{};
+  state.energy = encode(FIELD_TOTAL_ENERGY, this->values_[FIELD_TOTAL_ENERGY]);
+  state.wmaxlim_pct = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct);
+  state.wmaxlim_ena = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena);
+  state.rvrt_tms = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RvrtTms);
+  state.rmp_tms = this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RmpTms);
+  return state;
 }
 
-void SunSpecModbusServer::handle_write_multiple_(WiFiClient &client, uint8_t *buffer, size_t len) {
-  uint16_t reg_addr = (buffer[8] << 8) | buffer[9];
-  uint16_t quantity = (buffer[10] << 8) | buffer[11];
-  // buffer[12] = byte count
+void SunSpecModbusServer::persist_state_(uint32_t now, bool force) {
+  PersistedState state = this->capture_state_();
+  if (memcmp(&state, &this->saved_state_, sizeof(state)) == 0)
+    return;
 
-  uint16_t reg_idx = (reg_addr >= SUNSPEC_BASE_ADDRESS) ? reg_addr - SUNSPEC_BASE_ADDRESS : reg_addr;
+  // Enabling or releasing the limit is saved within seconds; new limit values and the
+  // energy count are coalesced into one write per persist_interval_
+  bool urgent = state.wmaxlim_ena != this->saved_state_.wmaxlim_ena;
+  uint32_t wait = urgent ? PERSIST_MIN_INTERVAL : this->persist_interval_;
+  if (!force && now - this->last_persist_ < wait)
+    return;
 
-  if (reg_idx + quantity > TOTAL_REGISTERS) {
-    this->send_error_(client, buffer, EX_ILLEGAL_DATA_ADDRESS);
+  this->last_persist_ = now;
+  if (!this->pref_.save(&state)) {
+    ESP_LOGW(TAG, "Failed to save control state");
     return;
   }
+  this->saved_state_ = state;
+  // Other changes reach flash with ESPHome's next preference sync
+  if (urgent || force)
+    global_preferences->sync();
+  ESP_LOGD(TAG, "Saved control state (WMaxLim_Ena=%u WMaxLimPct=%u)", state.wmaxlim_ena, state.wmaxlim_pct);
+}
+
+void SunSpecModbusServer::actuate_power_limit_(uint32_t now) {
+  float value;
+  if (this->controller_.is_enabled()) {
+    if (!this->close_loop_(now, value) || this->power_limit_number_ == nullptr)
+      return;
+    ESP_LOGD(TAG, "Setting Growatt power limit to %.1f%% (target %.1f%%, output %.0f W)", value,
+             this->actuator_.get_target(), this->values_[FIELD_AC_POWER]);
+  } else {
+    if (!this->actuator_.update(now, value) || this->power_limit_number_ == nullptr)
+      return;
+    ESP_LOGI(TAG, "Setting Growatt power limit to %.1f%% (target %.1f%%)", value, this->actuator_.get_target());
+  }
+  // Stamp before perform(): an optimistic number reports its new state from inside it
+  ControlTrace &trace = this->control_trace_;
+  if (trace.active && !trace.forwarded) {
+    trace.forwarded = true;
+    trace.forwarded_us = micros();
+    trace.output = value;
+    this->control_latency_[LATENCY_CONTROL_FORWARD].record(trace.forwarded_us - trace.received_us);
+  }
+  auto call = this->power_limit_number_->make_call();
+  call.set_value(value);
+  call.perform();
+}
 
-  // Write register values — track actual count in case buffer is shorter than declared quantity
-  uint16_t written = 0;
-  for (uint16_t i = 0; i < quantity && (size_t)(13 + i * 2 + 1) < len; i++) {
-    uint16_t value = (buffer[13 + i * 2] << 8) | buffer[14 + i * 2];
-    this->registers_[reg_idx + i] = value;
-    written++;
+bool SunSpecModbusServer::close_loop_(uint32_t now, float &output) {
+  if (!this->actuator_.has_target())
+    return false;
+  float reference = this->actuator_.reference(now);
+  float measured = this->values_[FIELD_AC_POWER];
+  // Nothing to regulate without a limit, and nothing to regulate on without a live
+  // measurement (not reported yet, or expired by stale_timeout): fall back to open loop
+  if (reference >= 100.0f || (this->sourced_ & field_bit(FIELD_AC_POWER)) == 0 || std::isnan(measured)) {
+    this->controller_.reset();
+    output = reference;
+  } else {
+    output = this->controller_.update(reference, measured * 100.0f / this->max_power_, now);
   }
-  this->process_write_(reg_idx, written);
+  return this->actuator_.pace(output, now, CLOSED_LOOP_MIN_STEP);
+}
 
-  // Send FC16 response: MBAP + unit + FC + start_addr + quantity
-  uint8_t response[12];
-  memcpy(response, buffer, 4);  // Transaction + protocol ID
-  response[4] = 0;
-  response[5] = 6;  // Length = 6
-  response[6] = buffer[6];  // Unit ID
-  response[7] = FC_WRITE_MULTIPLE_REGISTERS;
-  response[8] = buffer[8];  // Start address hi
-  response[9] = buffer[9];  // Start address lo
-  response[10] = buffer[10]; // Quantity hi
-  response[11] = buffer[11]; // Quantity lo
-  client.write(response, 12);
-  ESP_LOGD(TAG, "Write multiple %u regs starting at %u", quantity, reg_idx);
+void SunSpecModbusServer::enable_control_trace_(LatencyHistogram *latency, float tolerance) {
+  // Without a number there is nothing downstream to follow
+  if (this->power_limit_number_ == nullptr)
+    return;
+  this->control_latency_ = latency;
+  this->control_tolerance_ = tolerance;
+  this->power_limit_number_->add_on_state_callback([this](float state) { this->on_power_limit_state_(state); });
 }
 
-void SunSpecModbusServer::process_write_(uint16_t reg_start, uint16_t reg_count) {
-  // Check if any Model 123 registers were touched
-  if (reg_start + reg_count <= MODEL123_DATA_OFFSET) return;
-  if (reg_start >= MODEL123_DATA_OFFSET + MODEL123_LENGTH) return;
+void SunSpecModbusServer::start_control_trace_(uint32_t received_us) {
+  if (this->control_latency_ == nullptr)
+    return;
+  this->control_latency_[LATENCY_CONTROL_DISPATCH].record(micros() - received_us);
+
+  // A newer command supersedes a trace still in flight
+  ControlTrace &trace = this->control_trace_;
+  trace = ControlTrace{};
+  trace.active = true;
+  trace.received_us = received_us;
+  trace.limit_w = this->actuator_.get_target() * this->max_power_ / 100.0f;
+  // Only a curtailment has a point to wait for: the output dropping to the new limit
+  float band = this->control_tolerance_ * this->max_power_ / 100.0f;
+  trace.settling = (this->sourced_ & field_bit(FIELD_AC_POWER)) != 0 &&
+                   this->values_[FIELD_AC_POWER] > trace.limit_w + band;
+}
 
-  // Model 123 WMaxLimPct / WMaxLim_Ena control
-  uint16_t ena = this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena];
-  uint16_t pct_raw = this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct];
-  uint16_t rvrt_tms = this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct_RvrtTms];
-  int16_t sf = (int16_t)this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct_SF];
+void SunSpecModbusServer::on_power_limit_state_(float state) {
+  ControlTrace &trace = this->control_trace_;
+  // Match the value we sent (allowing for the number's step), not some other update
+  if (!trace.active || !trace.forwarded || trace.acked || fabsf(state - trace.output) > 0.5f)
+    return;
+  trace.acked = true;
+  this->control_latency_[LATENCY_CONTROL_ACK].record(micros() - trace.forwarded_us);
+  if (!trace.settling)
+    trace.active = false;
+}
 
-  // Apply scale factor: value * 10^sf
-  float pct;
-  if (sf == 0) {
-    pct = (float)pct_raw;
-  } else {
-    pct = (float)pct_raw * powf(10.0f, (float)sf);
+void SunSpecModbusServer::check_control_trace_() {
+  ControlTrace &trace = this->control_trace_;
+  if (!trace.active)
+    return;
+  uint32_t now = micros();
+  if (trace.forwarded && trace.settling &&
+      this->values_[FIELD_AC_POWER] <= trace.limit_w + this->control_tolerance_ * this->max_power_ / 100.0f) {
+    this->control_latency_[LATENCY_CONTROL_SETTLE].record(now - trace.forwarded_us);
+    this->control_latency_[LATENCY_CONTROL_TOTAL].record(now - trace.received_us);
+    ESP_LOGD(TAG, "Output settled at %.0f W (limit %.0f W) %u ms after the Model 123 write",
+             this->values_[FIELD_AC_POWER], trace.limit_w, (unsigned) ((now - trace.received_us) / 1000));
+    trace.active = false;
+    return;
   }
-  if (pct < 0.0f) pct = 0.0f;
-  if (pct > 100.0f) pct = 100.0f;
-
-  // Arm or disarm the revert timer
-  if (ena == 1 && rvrt_tms > 0) {
-    this->revert_active_ = true;
-    this->revert_deadline_ = millis() + ((uint32_t)rvrt_tms * 1000);
-    ESP_LOGD(TAG, "Revert timer armed: %u seconds", rvrt_tms);
-  } else {
-    this->revert_active_ = false;
+  if (now - trace.received_us < CONTROL_TRACE_TIMEOUT_US)
+    return;
+  if (trace.settling) {
+    ESP_LOGW(TAG, "Output still %.0f W, %u s after a Model 123 limit of %.0f W", this->values_[FIELD_AC_POWER],
+             (unsigned) (CONTROL_TRACE_TIMEOUT_US / 1000000), trace.limit_w);
   }
+  trace.active = false;
+}
 
-  if (this->power_limit_number_ != nullptr) {
-    float target = (ena == 1) ? pct : 100.0f;  // Disabled = restore full power
-    ESP_LOGI(TAG, "Model123: WMaxLim_Ena=%u WMaxLimPct=%.1f%% -> setting Growatt to %.1f%%", ena, pct, target);
-    auto call = this->power_limit_number_->make_call();
-    call.set_value(target);
-    call.perform();
-  }
+void SunSpecModbusServer::record_history_() {
+  // Register units, so a collector decodes history the same way as live registers
+  static const ValueField SAMPLED[] = {FIELD_AC_POWER,    FIELD_TOTAL_ENERGY, FIELD_DC_VOLTAGE,
+                                       FIELD_DC_CURRENT,  FIELD_PV2_VOLTAGE,  FIELD_PV2_CURRENT,
+                                       FIELD_TEMPERATURE, FIELD_STATE};  // HISTORY_AC_POWER onwards
+  static_assert(sizeof(SAMPLED) / sizeof(SAMPLED[0]) == HISTORY_FIELD_COUNT - HISTORY_AC_POWER, "one field per sample value");
+  HistorySample sample;
+  for (uint8_t i = 0; i < HISTORY_FIELD_COUNT - HISTORY_AC_POWER; i++)
+    sample.values[HISTORY_AC_POWER + i] = (int32_t) encode(SAMPLED[i], this->values_[SAMPLED[i]]);
+  this->history_.append(sample, millis());
 }
 
 void SunSpecModbusServer::init_registers_() {
+  this->init_static_registers_();
+  // Live values start at their FIELD_ENCODINGS defaults (every field is dirty)
+  this->update_registers_();
+  ESP_LOGI(TAG, "SunSpec registers initialized");
+}
+
+void SunSpecModbusServer::init_static_registers_() {
+  RegisterImage::WriteSection section(this->image_);
+
   // SunSpec identifier "SunS" (0x5375, 0x6E53)
-  this->registers_[SUNSPEC_ID_OFFSET] = 0x5375;      // "Su"
-  this->registers_[SUNSPEC_ID_OFFSET + 1] = 0x6E53;  // "nS"
+  this->image_.set(SUNSPEC_ID_OFFSET, 0x5375);      // "Su"
+  this->image_.set(SUNSPEC_ID_OFFSET + 1, 0x6E53);  // "nS"
 
   // Model 1 header (Common)
-  this->registers_[MODEL1_ID_OFFSET] = 1;          // Model ID
-  this->registers_[MODEL1_LENGTH_OFFSET] = MODEL1_LENGTH;  // Length
+  this->image_.set(MODEL1_ID_OFFSET, 1);                  // Model ID
+  this->image_.set(MODEL1_LENGTH_OFFSET, MODEL1_LENGTH);  // Length
 
   // Model 1 data - Manufacturer info
-  this->write_string_(MODEL1_DATA_OFFSET + 0, this->manufacturer_.c_str(), 32);   // Mn (offset 0-15)
-  this->write_string_(MODEL1_DATA_OFFSET + 16, this->model_.c_str(), 32);          // Md (offset 16-31)
-  this->write_string_(MODEL1_DATA_OFFSET + 32, "", 16);                            // Opt (offset 32-39)
-  this->write_string_(MODEL1_DATA_OFFSET + 40, this->version_.c_str(), 16);         // Vr (offset 40-47)
-  this->write_string_(MODEL1_DATA_OFFSET + 48, this->serial_.c_str(), 32);         // SN (offset 48-63)
-  this->registers_[MODEL1_DATA_OFFSET + 64] = 1;                                   // DA (Device Address)
-
+  this->write_string_(MODEL1_DATA_OFFSET + Model1::Mn, this->manufacturer_, 32);
+  this->write_string_(MODEL1_DATA_OFFSET + Model1::Md, this->model_, 32);
+  this->write_string_(MODEL1_DATA_OFFSET + Model1::Opt, "", 16);
+  this->write_string_(MODEL1_DATA_OFFSET + Model1::Vr, this->version_, 16);
+  this->write_string_(MODEL1_DATA_OFFSET + Model1::SN, this->serial_, 32);
+  this->image_.set(MODEL1_DATA_OFFSET + Model1::DA, 1);  // Device Address
+
+#if SUNSPEC_MODEL_120
   // Model 120 header (Nameplate Ratings)
-  this->registers_[MODEL120_ID_OFFSET] = 120;
-  this->registers_[MODEL120_LENGTH_OFFSET] = MODEL120_LENGTH;
+  this->image_.set(MODEL120_ID_OFFSET, 120);
+  this->image_.set(MODEL120_LENGTH_OFFSET, MODEL120_LENGTH);
 
   // Model 120 data
-  this->registers_[MODEL120_DATA_OFFSET + Model120::DERTyp]   = 4;                  // PV device
-  this->registers_[MODEL120_DATA_OFFSET + Model120::WRtg]     = this->max_power_;   // Rated power (W)
-  this->registers_[MODEL120_DATA_OFFSET + Model120::WRtg_SF]  = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VARtg]    = this->max_power_;   // Rated VA (same as W for unity PF)
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VARtg_SF] = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VArRtgQ1] = 0;                  // PV-only: no reactive power
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VArRtgQ2] = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VArRtgQ3] = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VArRtgQ4] = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::VArRtg_SF] = 0;
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::DERTyp, 4);               // PV device
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::WRtg, this->max_power_);  // Rated power (W)
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::WRtg_SF, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VARtg, this->max_power_);  // Rated VA (same as W for unity PF)
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VARtg_SF, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VArRtgQ1, 0);  // PV-only: no reactive power
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VArRtgQ2, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VArRtgQ3, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VArRtgQ4, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::VArRtg_SF, 0);
   // ARtg: max current sum of 3 phases = WRtg / (sqrt(3) * 400V) * 3
-  this->registers_[MODEL120_DATA_OFFSET + Model120::ARtg]     = (uint16_t)(this->max_power_ / 230.94f);
-  this->registers_[MODEL120_DATA_OFFSET + Model120::ARtg_SF]  = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::PFRtgQ1]  = (uint16_t)(int16_t)100;  // 1.00 with SF=-2
-  this->registers_[MODEL120_DATA_OFFSET + Model120::PFRtgQ2]  = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::PFRtgQ3]  = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::PFRtgQ4]  = 0;
-  this->registers_[MODEL120_DATA_OFFSET + Model120::PFRtg_SF] = (uint16_t)(int16_t)(-2);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::ARtg, (uint16_t)(this->max_power_ / 230.94f));
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::ARtg_SF, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::PFRtgQ1, (uint16_t)(int16_t)100);  // 1.00 with SF=-2
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::PFRtgQ2, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::PFRtgQ3, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::PFRtgQ4, 0);
+  this->image_.set(MODEL120_DATA_OFFSET + Model120::PFRtg_SF, (uint16_t)(int16_t)(-2));
   // Optional storage fields (17-25) left as 0 — not applicable for PV
+#endif
 
   // Model 103 header (Three-Phase Inverter)
-  this->registers_[MODEL103_ID_OFFSET] = 103;       // Model ID
-  this->registers_[MODEL103_LENGTH_OFFSET] = MODEL103_LENGTH;  // Length
+  this->image_.set(MODEL103_ID_OFFSET, 103);                  // Model ID
+  this->image_.set(MODEL103_LENGTH_OFFSET, MODEL103_LENGTH);  // Length
 
   // Model 103 scale factors (set once, don't change)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::A_SF] = (uint16_t)(int16_t)(-2);   // Current: 0.01A resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::V_SF] = (uint16_t)(int16_t)(-1);   // Voltage: 0.1V resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::W_SF] = 0;                          // Power: 1W resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::Hz_SF] = (uint16_t)(int16_t)(-2);  // Frequency: 0.01Hz resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::VA_SF] = 0;                         // VA: 1VA resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::VAr_SF] = 0;                        // VAr: 1VAr resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PF_SF] = (uint16_t)(int16_t)(-2);  // PF: 0.01 resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::WH_SF] = 0;                         // Energy: 1Wh resolution
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCA_SF] = (uint16_t)(int16_t)(-2); // DC Current: 0.01A
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCV_SF] = (uint16_t)(int16_t)(-1); // DC Voltage: 0.1V
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCW_SF] = 0;                        // DC Power: 1W
-  this->registers_[MODEL103_DATA_OFFSET + Model103::Tmp_SF] = 0;                        // Temperature: 1°C
-
-  // Initialize DC voltage (always present when connected)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCV] = 4500;  // 450.0V
-
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::A_SF, (uint16_t)(int16_t)(-2));    // Current: 0.01A resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::V_SF, (uint16_t)(int16_t)(-1));    // Voltage: 0.1V resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::W_SF, 0);                          // Power: 1W resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::Hz_SF, (uint16_t)(int16_t)(-2));   // Frequency: 0.01Hz resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::VA_SF, 0);                         // VA: 1VA resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::VAr_SF, 0);                        // VAr: 1VAr resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::PF_SF, (uint16_t)(int16_t)(-2));   // PF: 0.01 resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::WH_SF, 0);                         // Energy: 1Wh resolution
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::DCA_SF, (uint16_t)(int16_t)(-2));  // DC Current: 0.01A
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::DCV_SF, (uint16_t)(int16_t)(-1));  // DC Voltage: 0.1V
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::DCW_SF, 0);                        // DC Power: 1W
+  this->image_.set(MODEL103_DATA_OFFSET + Model103::Tmp_SF, 0);                        // Temperature: 1°C
+
+#if SUNSPEC_MODEL_160
   // Model 160 (Multiple MPPT) Header
-  this->registers_[MODEL160_ID_OFFSET] = 160;
-  this->registers_[MODEL160_LENGTH_OFFSET] = MODEL160_LENGTH;
+  this->image_.set(MODEL160_ID_OFFSET, 160);
+  this->image_.set(MODEL160_LENGTH_OFFSET, MODEL160_LENGTH);
 
   // Model 160 global scale factors
-  this->registers_[MODEL160_DATA_OFFSET + Model160::DCA_SF]  = (uint16_t)(int16_t)(-2);  // 0.01A
-  this->registers_[MODEL160_DATA_OFFSET + Model160::DCV_SF]  = (uint16_t)(int16_t)(-1);  // 0.1V
-  this->registers_[MODEL160_DATA_OFFSET + Model160::DCW_SF]  = 0;                         // 1W
-  this->registers_[MODEL160_DATA_OFFSET + Model160::DCWH_SF] = 0;
-  this->registers_[MODEL160_DATA_OFFSET + Model160::N]       = 2;  // PV1 + PV2
+  this->image_.set(MODEL160_DATA_OFFSET + Model160::DCA_SF, (uint16_t)(int16_t)(-2));  // 0.01A
+  this->image_.set(MODEL160_DATA_OFFSET + Model160::DCV_SF, (uint16_t)(int16_t)(-1));  // 0.1V
+  this->image_.set(MODEL160_DATA_OFFSET + Model160::DCW_SF, 0);                        // 1W
+  this->image_.set(MODEL160_DATA_OFFSET + Model160::DCWH_SF, 0);
+  this->image_.set(MODEL160_DATA_OFFSET + Model160::N, 2);  // PV1 + PV2
 
   // Tracker 0 (PV1) ID and IDStr ("PV1")
   uint16_t t0 = MODEL160_DATA_OFFSET + MODEL160_TRACKER_BASE + 0 * MODEL160_TRACKER_STRIDE;
-  this->registers_[t0 + Model160::T_ID] = 1;
+  this->image_.set(t0 + Model160::T_ID, 1);
   this->write_string_(t0 + 1, "PV1", 16);  // IDStr: 8 registers
 
   // Tracker 1 (PV2) ID and IDStr ("PV2")
   uint16_t t1 = MODEL160_DATA_OFFSET + MODEL160_TRACKER_BASE + 1 * MODEL160_TRACKER_STRIDE;
-  this->registers_[t1 + Model160::T_ID] = 2;
+  this->image_.set(t1 + Model160::T_ID, 2);
   this->write_string_(t1 + 1, "PV2", 16);  // IDStr: 8 registers
+#endif
 
   // Model 123 (Immediate Controls) Header
-  this->registers_[MODEL123_ID_OFFSET] = 123;
-  this->registers_[MODEL123_LENGTH_OFFSET] = MODEL123_LENGTH;
+  this->image_.set(MODEL123_ID_OFFSET, 123);
+  this->image_.set(MODEL123_LENGTH_OFFSET, MODEL123_LENGTH);
 
   // Model 123 scale factors
-  this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct_SF] = 0;   // Direct % (0-100)
-  this->registers_[MODEL123_DATA_OFFSET + Model123::OutPFSet_SF] = (uint16_t)(int16_t)(-2);
+  this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct_SF, 0);  // Direct % (0-100)
+  this->image_.set(MODEL123_DATA_OFFSET + Model123::OutPFSet_SF, (uint16_t)(int16_t)(-2));
 
   // Default: no power limit (100%), disabled
-  this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLimPct] = 100;
-  this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena] = 0;
+  this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLimPct, 100);
+  this->image_.set(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena, 0);
 
-  // End model marker (now at offset 147)
-  this->registers_[END_MODEL_OFFSET] = 0xFFFF;
-  this->registers_[END_MODEL_OFFSET + 1] = 0;
-
-  ESP_LOGI(TAG, "SunSpec registers initialized");
+  // End model marker (offset follows the enabled models)
+  this->image_.set(END_MODEL_OFFSET, 0xFFFF);
+  this->image_.set(END_MODEL_OFFSET + 1, 0);
 }
 
 void SunSpecModbusServer::update_registers_() {
-  // Update Model 103 registers with current simulated values
-
-  // AC Current (scale factor -2, so multiply by 100)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::A]    = safe_u16(this->values_.ac_current_total * 100);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::AphA] = safe_u16(this->values_.ac_current_a * 100);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::AphB] = safe_u16(this->values_.ac_current_b * 100);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::AphC] = safe_u16(this->values_.ac_current_c * 100);
-
-  // Line voltages (phase-to-phase, scale factor -1, multiply by 10)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PPVphAB] = safe_u16(this->values_.line_voltage_ab * 10);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PPVphBC] = safe_u16(this->values_.line_voltage_bc * 10);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PPVphCA] = safe_u16(this->values_.line_voltage_ca * 10);
-
-  // Phase voltages (phase-to-neutral, scale factor -1, multiply by 10)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PhVphA] = safe_u16(this->values_.ac_voltage_a * 10);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PhVphB] = safe_u16(this->values_.ac_voltage_b * 10);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PhVphC] = safe_u16(this->values_.ac_voltage_c * 10);
-
-  // AC Power (scale factor 0)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::W] = safe_u16(this->values_.ac_power);
-
-  // Frequency (scale factor -2, multiply by 100)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::Hz] = safe_u16(this->values_.frequency * 100);
-
-  // Apparent power (scale factor 0)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::VA] = safe_u16(this->values_.apparent_power);
-
-  // Reactive power (scale factor 0)
-  this->registers_[MODEL103_DATA_OFFSET + Model103::VAr] = safe_u16(this->values_.reactive_power);
-
-  // Power factor (scale factor -2, multiply by 100, signed: clamp to [-100, 100])
-  float pf_scaled = this->values_.power_factor * 100.0f;
-  int16_t pf_reg = std::isfinite(pf_scaled) ? static_cast<int16_t>(std::max(-100.0f, std::min(100.0f, pf_scaled))) : 0;
-  this->registers_[MODEL103_DATA_OFFSET + Model103::PF] = static_cast<uint16_t>(pf_reg);
-
-  // Energy (32-bit, scale factor 0)
-  this->write_uint32_(MODEL103_DATA_OFFSET + Model103::WH_HI, this->values_.total_energy);
-
-  // DC values
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCA] = safe_u16(this->values_.dc_current * 100);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCV] = safe_u16(this->values_.dc_voltage * 10);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::DCW] = safe_u16(this->values_.dc_power);
-
-  // Temperature
-  this->registers_[MODEL103_DATA_OFFSET + Model103::TmpCab] = static_cast<uint16_t>(this->values_.temperature);
-  this->registers_[MODEL103_DATA_OFFSET + Model103::TmpSnk] = static_cast<uint16_t>(this->values_.temperature);
-
-  // Operating state
-  this->registers_[MODEL103_DATA_OFFSET + Model103::St] = static_cast<uint16_t>(this->values_.state);
-
-  // Model 160 — tracker live data
-  // Tracker 0 (PV1) — reuse existing DC source values
-  uint16_t t0 = MODEL160_DATA_OFFSET + MODEL160_TRACKER_BASE + 0 * MODEL160_TRACKER_STRIDE;
-  this->registers_[t0 + Model160::T_DCA] = safe_u16(this->values_.dc_current * 100);
-  this->registers_[t0 + Model160::T_DCV] = safe_u16(this->values_.dc_voltage * 10);
-  this->registers_[t0 + Model160::T_DCW] = safe_u16(this->values_.dc_power);
-
-  // Tracker 1 (PV2) — from optional PV2 source sensors
-  uint16_t t1 = MODEL160_DATA_OFFSET + MODEL160_TRACKER_BASE + 1 * MODEL160_TRACKER_STRIDE;
-  if (this->source_pv2_voltage_ != nullptr && this->source_pv2_voltage_->has_state()) {
-    this->registers_[t1 + Model160::T_DCV] = safe_u16(this->source_pv2_voltage_->state * 10);
-  }
-  if (this->source_pv2_current_ != nullptr && this->source_pv2_current_->has_state()) {
-    this->registers_[t1 + Model160::T_DCA] = safe_u16(this->source_pv2_current_->state * 100);
-  }
-  if (this->source_pv2_power_ != nullptr && this->source_pv2_power_->has_state()) {
-    this->registers_[t1 + Model160::T_DCW] = safe_u16(this->source_pv2_power_->state);
+  // Re-encode only the fields that changed since the last pass
+  uint32_t dirty = this->dirty_;
+  if (dirty == 0)
+    return;
+  this->dirty_ = 0;
+
+  // One write section per pass: readers see either none or all of this pass's
+  // changes, so a multi-register value such as WH_HI/WH_LO is never torn
+  RegisterImage::WriteSection section(this->image_);
+  while (dirty != 0) {
+    ValueField field = static_cast<ValueField>(__builtin_ctz(dirty));
+    dirty &= dirty - 1;
+    const FieldEncoding &enc = FIELD_ENCODINGS[field];
+    if (enc.reg == NO_REGISTER)
+      continue;
+    uint32_t raw = encode(field, this->values_[field]);
+    if (enc.registers == 2) {
+      this->write_uint32_(enc.reg, raw);
+      continue;
+    }
+    this->image_.set(enc.reg, raw);
+    if (enc.mirror != NO_REGISTER)
+      this->image_.set(enc.mirror, raw);
   }
 }
 
@@ -541,183 +710,291 @@ void SunSpecModbusServer::write_string_(uint16_t offset, const char *str, uint16
   uint16_t reg_count = max_len / 2;
 
   for (uint16_t i = 0; i < reg_count; i++) {
-    uint8_t high_byte = (i * 2 < str_len) ? (uint8_t)str[i * 2] : 0;
-    uint8_t low_byte = (i * 2 + 1 < str_len) ? (uint8_t)str[i * 2 + 1] : 0;
-    this->registers_[offset + i] = (high_byte << 8) | low_byte;
+    uint8_t high_byte = ((size_t) i * 2 < str_len) ? (uint8_t)str[i * 2] : 0;
+    uint8_t low_byte = ((size_t) i * 2 + 1 < str_len) ? (uint8_t)str[i * 2 + 1] : 0;
+    this->image_.set(offset + i, (high_byte << 8) | low_byte);
   }
 }
 
 void SunSpecModbusServer::write_uint32_(uint16_t offset, uint32_t value) {
-  this->registers_[offset] = (value >> 16) & 0xFFFF;      // High word
-  this->registers_[offset + 1] = value & 0xFFFF;          // Low word
+  this->image_.set(offset, (value >> 16) & 0xFFFF);  // High word
+  this->image_.set(offset + 1, value & 0xFFFF);      // Low word
 }
 
 void SunSpecModbusServer::publish_sensors_() {
-  if (this->ac_power_sensor_ != nullptr)
-    this->ac_power_sensor_->publish_state(this->values_.ac_power);
-
-  if (this->ac_voltage_a_sensor_ != nullptr)
-    this->ac_voltage_a_sensor_->publish_state(this->values_.ac_voltage_a);
-
-  if (this->ac_voltage_b_sensor_ != nullptr)
-    this->ac_voltage_b_sensor_->publish_state(this->values_.ac_voltage_b);
-
-  if (this->ac_voltage_c_sensor_ != nullptr)
-    this->ac_voltage_c_sensor_->publish_state(this->values_.ac_voltage_c);
-
-  if (this->ac_current_a_sensor_ != nullptr)
-    this->ac_current_a_sensor_->publish_state(this->values_.ac_current_a);
-
-  if (this->ac_current_b_sensor_ != nullptr)
-    this->ac_current_b_sensor_->publish_state(this->values_.ac_current_b);
-
-  if (this->ac_current_c_sensor_ != nullptr)
-    this->ac_current_c_sensor_->publish_state(this->values_.ac_current_c);
-
-  if (this->ac_current_total_sensor_ != nullptr)
-    this->ac_current_total_sensor_->publish_state(this->values_.ac_current_total);
-
-  if (this->frequency_sensor_ != nullptr)
-    this->frequency_sensor_->publish_state(this->values_.frequency);
-
-  if (this->power_factor_sensor_ != nullptr)
-    this->power_factor_sensor_->publish_state(this->values_.power_factor);
-
-  if (this->total_energy_sensor_ != nullptr)
-    this->total_energy_sensor_->publish_state(this->values_.total_energy);
-
-  if (this->dc_voltage_sensor_ != nullptr)
-    this->dc_voltage_sensor_->publish_state(this->values_.dc_voltage);
-
-  if (this->dc_current_sensor_ != nullptr)
-    this->dc_current_sensor_->publish_state(this->values_.dc_current);
+  // Unchanged values are not published at all (rather than dropped by a sensor filter),
+  // so a flat day costs no filter, API or log work
+  uint32_t now = millis();
+  for (OutputBinding &output : this->outputs_) {
+    float value = this->values_[output.field];
+    if (!this->publish_due_(output, value, now)) {
+      this->suppressed_publishes_++;
+      continue;
+    }
+    output.sensor->publish_state(value);
+    output.published = true;
+    output.last_value = value;
+    output.last_publish = now;
+  }
+  if (this->suppressed_publishes_sensor_ != nullptr &&
+      (!this->suppressed_publishes_sensor_->has_state() ||
+       this->suppressed_publishes_sensor_->state != this->suppressed_publishes_)) {
+    this->suppressed_publishes_sensor_->publish_state(this->suppressed_publishes_);
+  }
 
-  if (this->dc_power_sensor_ != nullptr)
-    this->dc_power_sensor_->publish_state(this->values_.dc_power);
+  for (uint8_t i = 0; i < COUNTER_COUNT; i++) {
+    if (this->counter_sensors_[i] != nullptr && this->host_ != nullptr)
+      this->counter_sensors_[i]->publish_state(this->host_->server.get_counter(static_cast<ServerCounter>(i)));
+  }
+  if (this->heap_free_sensor_ != nullptr || this->heap_largest_block_sensor_ != nullptr)
+    this->publish_heap_();
+}
 
-  if (this->temperature_sensor_ != nullptr)
-    this->temperature_sensor_->publish_state(this->values_.temperature);
+void SunSpecModbusServer::publish_heap_() {
+  float free_bytes = NAN, largest_block = NAN;
+#if defined(USE_ESP32)
+  free_bytes = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+#elif defined(USE_ESP8266)
+  free_bytes = ESP.getFreeHeap();
+  largest_block = ESP.getMaxFreeBlockSize();
+#elif defined(__GLIBC__)
+  free_bytes = mallinfo2().fordblks;  // free bytes in the arena; no largest-block figure
+#endif
+  if (this->heap_free_sensor_ != nullptr)
+    this->heap_free_sensor_->publish_state(free_bytes);
+  if (this->heap_largest_block_sensor_ != nullptr)
+    this->heap_largest_block_sensor_->publish_state(largest_block);
 }
 
-void SunSpecModbusServer::update_from_sources_() {
-  // Read values from external source sensors (e.g., from modbus_controller)
-  // Only update values if the source sensor exists and has a valid state
+bool SunSpecModbusServer::publish_due_(const OutputBinding &output, float value, uint32_t now) const {
+  if (!output.change_only || !output.published)
+    return true;
+  if (output.heartbeat > 0 && now - output.last_publish >= output.heartbeat)
+    return true;
+  // NaN compares unequal to everything: publish only when it appears or goes away
+  if (std::isnan(value) || std::isnan(output.last_value))
+    return std::isnan(value) != std::isnan(output.last_value);
+  if (output.deadband > 0)
+    return fabsf(value - output.last_value) >= output.deadband;
+  return value != output.last_value;
+}
 
-  // AC Power
-  if (this->source_ac_power_ != nullptr && this->source_ac_power_->has_state()) {
-    this->values_.ac_power = this->source_ac_power_->state;
+void SunSpecModbusServer::publish_latency_() {
+  // Publish the window that just ended, then start a new one
+  for (uint8_t m = 0; m < LATENCY_COUNT; m++) {
+    LatencyHistogram &histogram = this->latency_[m];
+    sensor::Sensor **sensors = this->latency_sensors_[m];
+    if (histogram.count() > 0) {
+      if (sensors[LATENCY_P50] != nullptr)
+        sensors[LATENCY_P50]->publish_state(histogram.percentile(50));
+      if (sensors[LATENCY_P99] != nullptr)
+        sensors[LATENCY_P99]->publish_state(histogram.percentile(99));
+      if (sensors[LATENCY_MAX] != nullptr)
+        sensors[LATENCY_MAX]->publish_state(histogram.max());
+    }
+    histogram.reset();
   }
+}
 
-  // Phase voltages
-  if (this->source_voltage_a_ != nullptr && this->source_voltage_a_->has_state()) {
-    this->values_.ac_voltage_a = this->source_voltage_a_->state;
-  }
-  if (this->source_voltage_b_ != nullptr && this->source_voltage_b_->has_state()) {
-    this->values_.ac_voltage_b = this->source_voltage_b_->state;
-  }
-  if (this->source_voltage_c_ != nullptr && this->source_voltage_c_->has_state()) {
-    this->values_.ac_voltage_c = this->source_voltage_c_->state;
+void SunSpecModbusServer::subscribe_sources_() {
+  // Every source state is timestamped for expire_sources_(). In event-driven mode it is
+  // also stored (marking it dirty) and pushed straight into the register image, so
+  // Modbus readers see it on the next request instead of after the next update_interval_ tick
+  uint32_t now = millis();
+  for (size_t i = 0; i < this->sources_.size(); i++) {
+    this->sources_[i].updated = now;  // a source silent since boot expires stale_timeout_ from here
+    this->sources_[i].sensor->add_on_state_callback([this, i](float state) {
+      FieldBinding &source = this->sources_[i];
+      source.updated = millis();
+      source.stale = false;
+      this->stale_ &= ~field_bit(source.field);
+      if (this->event_driven_) {
+        this->ingest_(source.field, state);
+        this->refresh_registers_();
+      }
+    });
   }
+}
 
-  // Calculate line voltages from phase voltages (phase-to-phase = phase * sqrt(3))
-  this->values_.line_voltage_ab = this->values_.ac_voltage_a * 1.732f;
-  this->values_.line_voltage_bc = this->values_.ac_voltage_b * 1.732f;
-  this->values_.line_voltage_ca = this->values_.ac_voltage_c * 1.732f;
-
-  // Phase currents
-  if (this->source_current_a_ != nullptr && this->source_current_a_->has_state()) {
-    this->values_.ac_current_a = this->source_current_a_->state;
+void SunSpecModbusServer::expire_sources_(uint32_t now) {
+  // A source that stopped publishing (inverter off, RS485 down) is served as unavailable
+  // rather than repeating its last value: 0 in the registers, NaN on the output sensors,
+  // and the operating state falls back as if it were not wired
+  for (FieldBinding &source : this->sources_) {
+    if (source.stale || now - source.updated < this->stale_timeout_)
+      continue;
+    source.stale = true;
+    this->stale_ |= field_bit(source.field);
+    this->sourced_ &= ~field_bit(source.field);
+    if (source.field != FIELD_TOTAL_ENERGY)  // a counter keeps its last value; 0 would look like a reset
+      this->store_(source.field, NAN);
+    ESP_LOGW(TAG, "Source '%s' has not updated for %u s", source.sensor->get_name().c_str(),
+             (unsigned) ((now - source.updated) / 1000));
   }
-  if (this->source_current_b_ != nullptr && this->source_current_b_->has_state()) {
-    this->values_.ac_current_b = this->source_current_b_->state;
+}
+
+void SunSpecModbusServer::note_demand_(const ModbusTcpServer &server, uint8_t device, uint32_t now) {
+  uint32_t chunks = 0;
+  for (uint8_t chunk = 0; chunk < DEMAND_CHUNKS; chunk++) {
+    uint8_t reads = server.get_chunk_reads(device, chunk);
+    if (reads != this->chunk_reads_seen_[chunk]) {
+      this->chunk_reads_seen_[chunk] = reads;
+      chunks |= 1UL << chunk;
+    }
   }
-  if (this->source_current_c_ != nullptr && this->source_current_c_->has_state()) {
-    this->values_.ac_current_c = this->source_current_c_->state;
+  if (chunks == 0)
+    return;
+
+  for (const FieldEncoding &enc : FIELD_ENCODINGS) {
+    if (!(field_chunks(enc) & chunks))
+      continue;
+    uint32_t &last = this->last_read_[enc.field];
+    uint32_t &period = this->read_period_[enc.field];
+    if (last != 0) {
+      uint32_t gap = now - last;
+      if (period != 0 && gap > 4 * period) {
+        period = 0;  // a pause rather than a slower poll rate: measure afresh
+      } else {
+        period = period == 0 ? gap : (3 * period + gap) / 4;  // smoothed over ~4 reads
+      }
+    }
+    last = now;
   }
+}
 
-  // Total current = sum of phase currents
-  this->values_.ac_current_total = this->values_.ac_current_a +
-                                    this->values_.ac_current_b +
-                                    this->values_.ac_current_c;
+uint32_t SunSpecModbusServer::poll_period_(const SourcePoller &poller, uint32_t now) const {
+  // As often as clients read its most-read value, but no faster than interval;
+  // idle_interval once its values have missed about four reads
+  uint32_t period = poller.idle_interval;
+  for (uint32_t bits = poller.fields; bits != 0; bits &= bits - 1) {
+    uint8_t field = __builtin_ctz(bits);
+    uint32_t wanted = std::max(poller.interval, this->read_period_[field]);
+    if (this->last_read_[field] == 0 || now - this->last_read_[field] >= 4 * wanted)
+      continue;
+    if (wanted < period)
+      period = wanted;
+  }
+  return period;
+}
 
-  // Frequency
-  if (this->source_frequency_ != nullptr && this->source_frequency_->has_state()) {
-    this->values_.frequency = this->source_frequency_->state;
-  }
+void SunSpecModbusServer::run_pollers_(uint32_t now) {
+  // Update every due poller, the most-read first so its requests lead the RS485 queue.
+  // Each poller is updated at most once per pass, whatever its period.
+  while (true) {
+    SourcePoller *next = nullptr;
+    uint32_t next_period = 0;
+    for (SourcePoller &poller : this->pollers_) {
+      if (poller.polled && poller.last_poll == now)
+        continue;
+      uint32_t period = this->poll_period_(poller, now);
+      if (poller.polled && now - poller.last_poll < period)
+        continue;
+      if (next == nullptr || period < next_period) {
+        next = &poller;
+        next_period = period;
+      }
+    }
+    if (next == nullptr)
+      return;
 
-  // Power factor
-  if (this->source_power_factor_ != nullptr && this->source_power_factor_->has_state()) {
-    this->values_.power_factor = this->source_power_factor_->state;
+    if (!next->polled)
+      next->component->stop_poller();  // from now on only we update it
+    bool hot = next_period < next->idle_interval;
+    if (hot != next->hot || !next->polled)
+      ESP_LOGD(TAG, "Poller %u: %s, every %u ms", (unsigned) (next - this->pollers_.data()),
+               hot ? "values in demand" : "idle", next_period);
+    next->hot = hot;
+    next->polled = true;
+    next->last_poll = now;
+    next->component->update();
   }
+}
 
-  // Calculate apparent power (VA) = P / PF
-  if (this->values_.power_factor > 0) {
-    this->values_.apparent_power = this->values_.ac_power / this->values_.power_factor;
-  } else {
-    this->values_.apparent_power = this->values_.ac_power;
-  }
+void SunSpecModbusServer::refresh_registers_() {
+  this->derive_values_();
+  this->update_registers_();
+  // Runs for every source event in event-driven mode, so settling is seen as it happens
+  this->check_control_trace_();
+}
 
-  // Calculate reactive power (VAr) = sqrt(VA^2 - W^2)
-  float va_squared = this->values_.apparent_power * this->values_.apparent_power;
-  float w_squared = this->values_.ac_power * this->values_.ac_power;
-  if (va_squared > w_squared) {
-    this->values_.reactive_power = sqrtf(va_squared - w_squared);
-  } else {
-    this->values_.reactive_power = 0;
+void SunSpecModbusServer::update_from_sources_() {
+  // Read values from external source sensors (e.g., from modbus_controller) that have
+  // a valid state; every value that actually changes is marked dirty for update_registers_()
+  for (const FieldBinding &source : this->sources_) {
+    if (source.sensor->has_state() && !source.stale)
+      this->ingest_(source.field, source.sensor->state);
   }
+}
 
-  // Total energy (Wh)
-  if (this->source_total_energy_ != nullptr && this->source_total_energy_->has_state()) {
-    this->values_.total_energy = (uint32_t)this->source_total_energy_->state;
-  }
+void SunSpecModbusServer::derive_values_() {
+  // Recompute derived values whose inputs are dirty
+  const float *v = this->values_;
 
-  // DC voltage
-  if (this->source_dc_voltage_ != nullptr && this->source_dc_voltage_->has_state()) {
-    this->values_.dc_voltage = this->source_dc_voltage_->state;
-  }
+  // Calculate line voltages from phase voltages (phase-to-phase = phase * sqrt(3))
+  if (this->dirty_ & field_bit(FIELD_AC_VOLTAGE_A))
+    this->store_(FIELD_LINE_VOLTAGE_AB, v[FIELD_AC_VOLTAGE_A] * 1.732f);
+  if (this->dirty_ & field_bit(FIELD_AC_VOLTAGE_B))
+    this->store_(FIELD_LINE_VOLTAGE_BC, v[FIELD_AC_VOLTAGE_B] * 1.732f);
+  if (this->dirty_ & field_bit(FIELD_AC_VOLTAGE_C))
+    this->store_(FIELD_LINE_VOLTAGE_CA, v[FIELD_AC_VOLTAGE_C] * 1.732f);
 
-  // DC current
-  if (this->source_dc_current_ != nullptr && this->source_dc_current_->has_state()) {
-    this->values_.dc_current = this->source_dc_current_->state;
-  }
+  // Total current = sum of phase currents
+  if (this->dirty_ & (field_bit(FIELD_AC_CURRENT_A) | field_bit(FIELD_AC_CURRENT_B) | field_bit(FIELD_AC_CURRENT_C)))
+    this->store_(FIELD_AC_CURRENT_TOTAL, v[FIELD_AC_CURRENT_A] + v[FIELD_AC_CURRENT_B] + v[FIELD_AC_CURRENT_C]);
+
+  if (this->dirty_ & (field_bit(FIELD_AC_POWER) | field_bit(FIELD_POWER_FACTOR))) {
+    // Calculate apparent power (VA) = P / PF
+    float apparent_power = v[FIELD_AC_POWER];
+    if (v[FIELD_POWER_FACTOR] > 0)
+      apparent_power = v[FIELD_AC_POWER] / v[FIELD_POWER_FACTOR];
+    this->store_(FIELD_APPARENT_POWER, apparent_power);
 
-  // DC power - read from source or calculate from V*I
-  if (this->source_dc_power_ != nullptr && this->source_dc_power_->has_state()) {
-    this->values_.dc_power = this->source_dc_power_->state;
-  } else if (this->values_.dc_voltage > 0 && this->values_.dc_current > 0) {
-    this->values_.dc_power = this->values_.dc_voltage * this->values_.dc_current;
+    // Calculate reactive power (VAr) = sqrt(VA^2 - W^2)
+    float va_squared = apparent_power * apparent_power;
+    float w_squared = v[FIELD_AC_POWER] * v[FIELD_AC_POWER];
+    this->store_(FIELD_REACTIVE_POWER, va_squared > w_squared ? sqrtf(va_squared - w_squared) : 0.0f);
   }
 
-  // Temperature
-  if (this->source_temperature_ != nullptr && this->source_temperature_->has_state()) {
-    this->values_.temperature = (int16_t)this->source_temperature_->state;
+  // DC power - calculate from V*I when there is no DC power source
+  if (!(this->sourced_ & field_bit(FIELD_DC_POWER)) &&
+      (this->dirty_ & (field_bit(FIELD_DC_VOLTAGE) | field_bit(FIELD_DC_CURRENT))) && v[FIELD_DC_VOLTAGE] > 0 &&
+      v[FIELD_DC_CURRENT] > 0) {
+    this->store_(FIELD_DC_POWER, v[FIELD_DC_VOLTAGE] * v[FIELD_DC_CURRENT]);
   }
 
   // Set operating state
   // Primary: use inverter_status from Growatt if available (0=waiting, 1=normal, 3=fault)
   // Fallback: derive from dc_voltage and ac_power when inverter_status is not wired
-  bool throttled = (this->registers_[MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena] == 1);
-  if (this->source_inverter_status_ != nullptr && this->source_inverter_status_->has_state()) {
-    int status = (int)this->source_inverter_status_->state;
+  // An expired AC power source overrides both: the GX must not see a producing inverter
+  // whose W register is "not implemented". With inverter_status still live the inverter
+  // is up but its output unknown (fault); otherwise nothing is heard from it (off).
+  bool throttled = (this->image_.get(MODEL123_DATA_OFFSET + Model123::WMaxLim_Ena) == 1);
+  InverterState state;
+  if (this->stale_ & field_bit(FIELD_AC_POWER)) {
+    state = (this->sourced_ & field_bit(FIELD_INVERTER_STATUS)) ? InverterState::FAULT : InverterState::OFF;
+  } else if (this->sourced_ & field_bit(FIELD_INVERTER_STATUS)) {
+    int status = (int) v[FIELD_INVERTER_STATUS];
     if (status == 1) {  // normal — producing or ready
-      this->values_.state = throttled ? InverterState::THROTTLED : InverterState::MPPT;
+      state = throttled ? InverterState::THROTTLED : InverterState::MPPT;
     } else if (status == 0) {  // waiting — sun present but not yet producing
-      this->values_.state = InverterState::STANDBY;
+      state = InverterState::STANDBY;
     } else if (status == 3) {  // fault
-      this->values_.state = InverterState::FAULT;
+      state = InverterState::FAULT;
     } else {
-      this->values_.state = InverterState::SLEEPING;
+      state = InverterState::SLEEPING;
     }
   } else {
     // Fallback: no inverter_status sensor wired — derive from measurements
-    if (this->values_.ac_power > 0) {
-      this->values_.state = throttled ? InverterState::THROTTLED : InverterState::MPPT;
-    } else if (this->values_.dc_voltage > 0) {
-      this->values_.state = InverterState::STANDBY;
+    if (v[FIELD_AC_POWER] > 0) {
+      state = throttled ? InverterState::THROTTLED : InverterState::MPPT;
+    } else if (v[FIELD_DC_VOLTAGE] > 0) {
+      state = InverterState::STANDBY;
     } else {
-      this->values_.state = InverterState::SLEEPING;
+      state = InverterState::SLEEPING;
     }
   }
+  this->store_(FIELD_STATE, static_cast<float>(state));
 }
 
 }  // namespace sunspec_modbus_server
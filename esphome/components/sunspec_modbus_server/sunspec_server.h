@@ -1,19 +1,28 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/preferences.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/number/number.h"
-
-#ifdef USE_ARDUINO
-#ifdef USE_ESP32
-#include <WiFi.h>
-#elif defined(USE_ESP8266)
-#include <ESP8266WiFi.h>
-#endif
-#endif
+#include "sunspec_registers.h"
+#include "modbus_tcp_server.h"
+#include "power_actuator.h"
+#include "power_controller.h"
+#include "history.h"
+#include "wifi_transport.h"
+#include "posix_transport.h"
+#include "server_task.h"
+#include "histogram.h"
+
+#include <initializer_list>
 #include <vector>
 #include <memory>
 
+#if !defined(USE_ARDUINO) && !defined(__linux__)
+#error "sunspec_modbus_server needs the Arduino framework (ESP32/ESP8266) or the Linux host platform"
+#endif
+
 namespace esphome {
 namespace sunspec_modbus_server {
 
@@ -29,325 +38,374 @@ enum class InverterState : uint16_t {
   STANDBY = 8
 };
 
-// SunSpec register layout constants
-static const uint16_t SUNSPEC_BASE_ADDRESS = 40000;
-static const uint16_t SUNSPEC_ID_OFFSET = 0;
-static const uint16_t MODEL1_ID_OFFSET = 2;
-static const uint16_t MODEL1_LENGTH_OFFSET = 3;
-static const uint16_t MODEL1_DATA_OFFSET = 4;
-static const uint16_t MODEL1_LENGTH = 65;
-
-// Model 120 (Nameplate Ratings) — inserted between Model 1 and Model 103
-static const uint16_t MODEL120_ID_OFFSET = 69;
-static const uint16_t MODEL120_LENGTH_OFFSET = 70;
-static const uint16_t MODEL120_DATA_OFFSET = 71;
-static const uint16_t MODEL120_LENGTH = 26;
-
-static const uint16_t MODEL103_ID_OFFSET = 97;
-static const uint16_t MODEL103_LENGTH_OFFSET = 98;
-static const uint16_t MODEL103_DATA_OFFSET = 99;
-static const uint16_t MODEL103_LENGTH = 50;
-
-// Model 160 (Multiple MPPT) — 8 global + 2 trackers * 20 = 48 data registers
-static const uint16_t MODEL160_ID_OFFSET = 149;
-static const uint16_t MODEL160_LENGTH_OFFSET = 150;
-static const uint16_t MODEL160_DATA_OFFSET = 151;
-static const uint16_t MODEL160_LENGTH = 48;
-static const uint16_t MODEL160_TRACKER_BASE = 8;    // data offset of first tracker block
-static const uint16_t MODEL160_TRACKER_STRIDE = 20; // registers per tracker block
-
-// Model 123 (Immediate Controls)
-static const uint16_t MODEL123_ID_OFFSET = 199;
-static const uint16_t MODEL123_LENGTH_OFFSET = 200;
-static const uint16_t MODEL123_DATA_OFFSET = 201;
-static const uint16_t MODEL123_LENGTH = 24;
-
-// End marker and total
-static const uint16_t END_MODEL_OFFSET = 225;
-static const uint16_t TOTAL_REGISTERS = 227;
-
-// Model 120 register offsets (relative to MODEL120_DATA_OFFSET)
-namespace Model120 {
-  static const uint8_t DERTyp = 0;       // DER type (4 = PV)
-  static const uint8_t WRtg = 1;         // Continuous power rating (W)
-  static const uint8_t WRtg_SF = 2;      // Scale factor
-  static const uint8_t VARtg = 3;        // Continuous VA rating
-  static const uint8_t VARtg_SF = 4;     // Scale factor
-  static const uint8_t VArRtgQ1 = 5;     // VAr capability Q1
-  static const uint8_t VArRtgQ2 = 6;     // VAr capability Q2
-  static const uint8_t VArRtgQ3 = 7;     // VAr capability Q3
-  static const uint8_t VArRtgQ4 = 8;     // VAr capability Q4
-  static const uint8_t VArRtg_SF = 9;    // Scale factor
-  static const uint8_t ARtg = 10;        // Max RMS AC current (sum of phases)
-  static const uint8_t ARtg_SF = 11;     // Scale factor
-  static const uint8_t PFRtgQ1 = 12;     // Min power factor Q1
-  static const uint8_t PFRtgQ2 = 13;     // Min power factor Q2
-  static const uint8_t PFRtgQ3 = 14;     // Min power factor Q3
-  static const uint8_t PFRtgQ4 = 15;     // Min power factor Q4
-  static const uint8_t PFRtg_SF = 16;    // Scale factor
-  // 17-25: optional storage fields + pad (left as 0)
-}  // namespace Model120
-
-// Model 103 register offsets (relative to MODEL103_DATA_OFFSET)
-namespace Model103 {
-  static const uint8_t A = 0;        // AC Total Current
-  static const uint8_t AphA = 1;     // Phase A Current
-  static const uint8_t AphB = 2;     // Phase B Current
-  static const uint8_t AphC = 3;     // Phase C Current
-  static const uint8_t A_SF = 4;     // Current Scale Factor
-  static const uint8_t PPVphAB = 5;  // Phase AB Voltage
-  static const uint8_t PPVphBC = 6;  // Phase BC Voltage
-  static const uint8_t PPVphCA = 7;  // Phase CA Voltage
-  static const uint8_t PhVphA = 8;   // Phase A Voltage
-  static const uint8_t PhVphB = 9;   // Phase B Voltage
-  static const uint8_t PhVphC = 10;  // Phase C Voltage
-  static const uint8_t V_SF = 11;    // Voltage Scale Factor
-  static const uint8_t W = 12;       // AC Power
-  static const uint8_t W_SF = 13;    // Power Scale Factor
-  static const uint8_t Hz = 14;      // Frequency
-  static const uint8_t Hz_SF = 15;   // Frequency Scale Factor
-  static const uint8_t VA = 16;      // Apparent Power
-  static const uint8_t VA_SF = 17;   // VA Scale Factor
-  static const uint8_t VAr = 18;     // Reactive Power
-  static const uint8_t VAr_SF = 19;  // VAr Scale Factor
-  static const uint8_t PF = 20;      // Power Factor
-  static const uint8_t PF_SF = 21;   // PF Scale Factor
-  static const uint8_t WH_HI = 22;   // Energy High Word
-  static const uint8_t WH_LO = 23;   // Energy Low Word
-  static const uint8_t WH_SF = 24;   // Energy Scale Factor
-  static const uint8_t DCA = 25;     // DC Current
-  static const uint8_t DCA_SF = 26;  // DC Current SF
-  static const uint8_t DCV = 27;     // DC Voltage
-  static const uint8_t DCV_SF = 28;  // DC Voltage SF
-  static const uint8_t DCW = 29;     // DC Power
-  static const uint8_t DCW_SF = 30;  // DC Power SF
-  static const uint8_t TmpCab = 31;  // Cabinet Temperature
-  static const uint8_t TmpSnk = 32;  // Heat Sink Temperature
-  static const uint8_t TmpTrns = 33; // Transformer Temperature
-  static const uint8_t TmpOt = 34;   // Other Temperature
-  static const uint8_t Tmp_SF = 35;  // Temperature Scale Factor
-  static const uint8_t St = 36;      // Operating State
-  static const uint8_t StVnd = 37;   // Vendor Operating State
-}  // namespace Model103
-
-// Model 160 register offsets (relative to MODEL160_DATA_OFFSET)
-namespace Model160 {
-  static const uint8_t DCA_SF  = 0;   // Current scale factor (all trackers)
-  static const uint8_t DCV_SF  = 1;   // Voltage scale factor
-  static const uint8_t DCW_SF  = 2;   // Power scale factor
-  static const uint8_t DCWH_SF = 3;   // Energy scale factor
-  static const uint8_t Evt1    = 4;   // Global events (high word)
-  static const uint8_t Evt2    = 5;   // Global events (low word)
-  static const uint8_t N       = 6;   // Number of trackers
-  static const uint8_t TmsPer  = 7;   // Timestamp period
-  // Per-tracker block offsets (from start of tracker block, 20 regs each)
-  static const uint8_t T_ID    = 0;   // Tracker input ID
-  // T_IDStr occupies offsets 1-8 (8 registers)
-  static const uint8_t T_DCA   = 9;   // DC current
-  static const uint8_t T_DCV   = 10;  // DC voltage  ← Victron reads this
-  static const uint8_t T_DCW   = 11;  // DC power    ← Victron reads this
-}  // namespace Model160
-
-// Model 123 register offsets (relative to MODEL123_DATA_OFFSET)
-namespace Model123 {
-  // Connection controls (3 registers before power limit fields)
-  static const uint8_t Conn_WinTms = 0;        // Time to connect (s)
-  static const uint8_t Conn_RvrtTms = 1;       // Time to revert connection (s)
-  static const uint8_t Conn = 2;               // Connect/disconnect (1=connect)
-  // Power limit controls — Victron writes at immediateControlOffset+5 = data[3]
-  static const uint8_t WMaxLimPct = 3;         // Max power output %
-  static const uint8_t WMaxLimPct_WinTms = 4;
-  static const uint8_t WMaxLimPct_RvrtTms = 5;
-  static const uint8_t WMaxLimPct_RmpTms = 6;
-  static const uint8_t WMaxLim_Ena = 7;        // 0=disabled, 1=enabled
-  static const uint8_t OutPFSet = 8;
-  static const uint8_t OutPFSet_WinTms = 9;
-  static const uint8_t OutPFSet_RvrtTms = 10;
-  static const uint8_t OutPFSet_RmpTms = 11;
-  static const uint8_t OutPFSet_Ena = 12;
-  static const uint8_t VArPct_Mod = 13;
-  static const uint8_t VArPct_WinTms = 14;
-  static const uint8_t VArPct_RvrtTms = 15;
-  static const uint8_t VArPct_RmpTms = 16;
-  static const uint8_t VArSetPct = 17;
-  static const uint8_t VArSetPct_Ena = 18;
-  static const uint8_t WMaxLimPct_SF = 19;     // Scale factor (we set to 0)
-  static const uint8_t OutPFSet_SF = 20;
-  // 21-23: padding
-}  // namespace Model123
-
-// Inverter values (from source sensors)
-struct InverterValues {
-  float ac_power{0};
-  float ac_voltage_a{230.0f};
-  float ac_voltage_b{230.0f};
-  float ac_voltage_c{230.0f};
-  float line_voltage_ab{398.0f};
-  float line_voltage_bc{398.0f};
-  float line_voltage_ca{398.0f};
-  float ac_current_total{0};
-  float ac_current_a{0};
-  float ac_current_b{0};
-  float ac_current_c{0};
-  float frequency{50.0f};
-  float power_factor{0.99f};
-  float apparent_power{0};
-  float reactive_power{0};
-  uint32_t total_energy{0};
-  float dc_voltage{450.0f};
-  float dc_current{0};
-  float dc_power{0};
-  int16_t temperature{35};
-  InverterState state{InverterState::MPPT};
+// Inverter values, one float each (see FIELD_ENCODINGS in sunspec_server.cpp for
+// their registers) and one bit each in the dirty bitmap
+enum ValueField : uint8_t {
+  FIELD_AC_POWER,
+  FIELD_AC_VOLTAGE_A,
+  FIELD_AC_VOLTAGE_B,
+  FIELD_AC_VOLTAGE_C,
+  FIELD_LINE_VOLTAGE_AB,
+  FIELD_LINE_VOLTAGE_BC,
+  FIELD_LINE_VOLTAGE_CA,
+  FIELD_AC_CURRENT_TOTAL,
+  FIELD_AC_CURRENT_A,
+  FIELD_AC_CURRENT_B,
+  FIELD_AC_CURRENT_C,
+  FIELD_FREQUENCY,
+  FIELD_POWER_FACTOR,
+  FIELD_APPARENT_POWER,
+  FIELD_REACTIVE_POWER,
+  FIELD_TOTAL_ENERGY,
+  FIELD_DC_VOLTAGE,
+  FIELD_DC_CURRENT,
+  FIELD_DC_POWER,
+  FIELD_TEMPERATURE,
+  FIELD_STATE,
+  FIELD_PV2_VOLTAGE,
+  FIELD_PV2_CURRENT,
+  FIELD_PV2_POWER,
+  FIELD_INVERTER_STATUS,  // Growatt status code, input to FIELD_STATE (no register)
+  FIELD_COUNT,
+};
+static_assert(FIELD_COUNT <= 32, "dirty bitmap is a uint32_t");
+
+inline constexpr uint32_t field_bit(ValueField field) { return 1UL << field; }
+static const uint32_t ALL_FIELDS = (FIELD_COUNT == 32) ? 0xFFFFFFFFUL : ((1UL << FIELD_COUNT) - 1);
+
+// A configured source sensor, the value it feeds and when it last published
+struct FieldBinding {
+  sensor::Sensor *sensor;
+  ValueField field;
+  uint32_t updated{0};
+  bool stale{false};  // silent for stale_timeout_: its value is not served
+};
+
+// A component that fetches some of the sources (growatt_solar, modbus_controller),
+// updated by the server at the rate clients read those values instead of on its own
+struct SourcePoller {
+  PollingComponent *component;
+  uint32_t fields;         // field_bit()s of the values it provides
+  uint32_t interval;       // fastest period, while clients read its values
+  uint32_t idle_interval;  // period while no client reads them
+  uint32_t last_poll{0};
+  bool polled{false};
+  bool hot{false};
+};
+
+// A configured output sensor, the value it publishes and when it may skip a publish
+struct OutputBinding {
+  sensor::Sensor *sensor;
+  ValueField field;
+  bool change_only;    // skip publishes that repeat the last published value
+  float deadband;      // with change_only: smallest change worth publishing (sensor units)
+  uint32_t heartbeat;  // with change_only: republish at least this often (ms, 0 = never)
+  bool published{false};
+  float last_value{0};
+  uint32_t last_publish{0};
+};
+
+// Latency histograms: per-request time in ModbusTcpServer, loop() in total and per phase,
+// and the control path of Model 123 commands
+enum LatencyMetric : uint8_t {
+  LATENCY_REQUEST,           // frame complete → response written
+  LATENCY_LOOP,              // whole loop()
+  LATENCY_SOURCE_UPDATE,     // update_from_sources_()
+  LATENCY_REGISTER_UPDATE,   // derive_values_() + update_registers_()
+  LATENCY_SENSOR_PUBLISH,    // publish_sensors_()
+  LATENCY_REVERT_CHECK,      // Model 123 revert timer
+  LATENCY_CLIENT_HANDLING,   // ModbusTcpServer::loop()
+  LATENCY_CONTROL_DISPATCH,  // write frame complete → Model 123 command handed to the actuator
+  LATENCY_CONTROL_FORWARD,   // write frame complete → power limit number called
+  LATENCY_CONTROL_ACK,       // number called → number reports the written value
+  LATENCY_CONTROL_SETTLE,    // number called → AC power inside the tolerance band (curtailments)
+  LATENCY_CONTROL_TOTAL,     // write frame complete → AC power inside the tolerance band
+  LATENCY_COUNT,
+};
+
+enum LatencyStat : uint8_t {
+  LATENCY_P50,
+  LATENCY_P99,
+  LATENCY_MAX,
+  LATENCY_STAT_COUNT,
+};
+
+// One Model 123 command followed from the write frame to the inverter output (micros())
+struct ControlTrace {
+  bool active{false};
+  bool forwarded{false};
+  bool acked{false};
+  bool settling{false};  // curtailment: waiting for AC power to drop into the band
+  uint32_t received_us{0};
+  uint32_t forwarded_us{0};
+  float output{0};   // first value sent to the number, matched against its state
+  float limit_w{0};  // target limit in W
+};
+
+// Model 123 control state and energy counter kept across reboots. Field order avoids
+// padding so two states compare with memcmp; bump PERSISTED_STATE_VERSION on layout changes.
+struct PersistedState {
+  uint32_t energy;       // WH, register units
+  uint16_t wmaxlim_pct;  // WMaxLimPct, raw register value
+  uint16_t wmaxlim_ena;
+  uint16_t rvrt_tms;  // revert timeout; the timer restarts from it after a reboot
+  uint16_t rmp_tms;
+};
+static constexpr uint32_t PERSISTED_STATE_VERSION = 1;
+
+// TCP server, socket backend and optional server task. Only the instance that owns the
+// server allocates one; devices added with add_device() are served through it.
+struct ServerHost {
+  ModbusTcpServer server;
+#ifdef USE_ARDUINO
+  WiFiTransport transport;
+#else
+  PosixTransport transport;
+#endif
+#ifdef SUNSPEC_HAS_SERVER_TASK
+  ServerTask task;
+#endif
 };
 
-class SunSpecModbusServer : public Component {
+class SunSpecModbusServer : public Component, public ServerListener {
  public:
   SunSpecModbusServer();
 
   void setup() override;
   void loop() override;
   void dump_config() override;
+  void on_shutdown() override;
   float get_setup_priority() const override { return setup_priority::AFTER_WIFI; }
 
   // Configuration setters
   void set_port(uint16_t port) { this->port_ = port; }
   void set_unit_id(uint8_t unit_id) { this->unit_id_ = unit_id; }
-  void set_manufacturer(const std::string &manufacturer) { this->manufacturer_ = manufacturer; }
-  void set_model(const std::string &model) { this->model_ = model; }
-  void set_serial(const std::string &serial) { this->serial_ = serial; }
-  void set_version(const std::string &version) { this->version_ = version; }
+  // Nameplate strings are not copied; codegen passes literals
+  void set_manufacturer(const char *manufacturer) { this->manufacturer_ = manufacturer; }
+  void set_model(const char *model) { this->model_ = model; }
+  void set_serial(const char *serial) { this->serial_ = serial; }
+  void set_version(const char *version) { this->version_ = version; }
   void set_update_interval(uint32_t update_interval) { this->update_interval_ = update_interval; }
+  void set_event_driven(bool event_driven) { this->event_driven_ = event_driven; }
   void set_max_power(uint16_t max_power) { this->max_power_ = max_power; }
-
-  // Source sensor setters (input from external components like modbus_controller)
-  void set_source_ac_power(sensor::Sensor *sensor) { this->source_ac_power_ = sensor; }
-  void set_source_voltage_a(sensor::Sensor *sensor) { this->source_voltage_a_ = sensor; }
-  void set_source_voltage_b(sensor::Sensor *sensor) { this->source_voltage_b_ = sensor; }
-  void set_source_voltage_c(sensor::Sensor *sensor) { this->source_voltage_c_ = sensor; }
-  void set_source_current_a(sensor::Sensor *sensor) { this->source_current_a_ = sensor; }
-  void set_source_current_b(sensor::Sensor *sensor) { this->source_current_b_ = sensor; }
-  void set_source_current_c(sensor::Sensor *sensor) { this->source_current_c_ = sensor; }
-  void set_source_frequency(sensor::Sensor *sensor) { this->source_frequency_ = sensor; }
-  void set_source_power_factor(sensor::Sensor *sensor) { this->source_power_factor_ = sensor; }
-  void set_source_total_energy(sensor::Sensor *sensor) { this->source_total_energy_ = sensor; }
-  void set_source_dc_voltage(sensor::Sensor *sensor) { this->source_dc_voltage_ = sensor; }
-  void set_source_dc_current(sensor::Sensor *sensor) { this->source_dc_current_ = sensor; }
-  void set_source_dc_power(sensor::Sensor *sensor) { this->source_dc_power_ = sensor; }
-  void set_source_temperature(sensor::Sensor *sensor) { this->source_temperature_ = sensor; }
-  void set_source_pv2_voltage(sensor::Sensor *sensor) { this->source_pv2_voltage_ = sensor; }
-  void set_source_pv2_current(sensor::Sensor *sensor) { this->source_pv2_current_ = sensor; }
-  void set_source_pv2_power(sensor::Sensor *sensor) { this->source_pv2_power_ = sensor; }
-  void set_source_inverter_status(sensor::Sensor *sensor) { this->source_inverter_status_ = sensor; }
+  void set_max_clients(uint8_t max_clients) { this->max_clients_ = max_clients; }
+  void set_client_timeout(uint32_t client_timeout) { this->client_timeout_ = client_timeout; }
+  void set_dedicated_task(bool dedicated_task) { this->dedicated_task_ = dedicated_task; }
+  void set_task_core(uint8_t task_core) { this->task_core_ = task_core; }
+  // Keep the Model 123 state and energy counter across reboots; changes are written at
+  // most once per persist_interval (enable/disable at once)
+  void set_restore_state(bool restore_state) { this->restore_state_ = restore_state; }
+  void set_persist_interval(uint32_t persist_interval) { this->persist_interval_ = persist_interval; }
+
+  // Source sensors (input from external components like modbus_controller) and output
+  // sensors (publish to Home Assistant); codegen adds only the configured ones
+  void add_source(ValueField field, sensor::Sensor *sensor) { this->sources_.push_back({sensor, field}); }
+  // A source that stays silent this long is served as its default value (0 = never)
+  void set_stale_timeout(uint32_t stale_timeout) { this->stale_timeout_ = stale_timeout; }
+  // Drive component's updates from client demand for the given fields
+  void add_poller(PollingComponent *component, uint32_t interval, uint32_t idle_interval,
+                  std::initializer_list<ValueField> fields) {
+    uint32_t bits = 0;
+    for (ValueField field : fields)
+      bits |= field_bit(field);
+    this->pollers_.push_back({component, bits, interval, idle_interval});
+  }
+  void add_output(ValueField field, sensor::Sensor *sensor, bool change_only = false, float deadband = 0,
+                  uint32_t heartbeat = 0) {
+    this->outputs_.push_back({sensor, field, change_only, deadband, heartbeat});
+  }
+  // Count of output publishes skipped by change_only / deadband
+  void set_suppressed_publishes_sensor(sensor::Sensor *sensor) { this->suppressed_publishes_sensor_ = sensor; }
 
   // Power limit number setter (target for Growatt active power rate)
   void set_power_limit_number(number::Number *number) { this->power_limit_number_ = number; }
-
-  // Output sensor setters (publish to Home Assistant)
-  void set_ac_power_sensor(sensor::Sensor *sensor) { this->ac_power_sensor_ = sensor; }
-  void set_ac_voltage_a_sensor(sensor::Sensor *sensor) { this->ac_voltage_a_sensor_ = sensor; }
-  void set_ac_voltage_b_sensor(sensor::Sensor *sensor) { this->ac_voltage_b_sensor_ = sensor; }
-  void set_ac_voltage_c_sensor(sensor::Sensor *sensor) { this->ac_voltage_c_sensor_ = sensor; }
-  void set_ac_current_a_sensor(sensor::Sensor *sensor) { this->ac_current_a_sensor_ = sensor; }
-  void set_ac_current_b_sensor(sensor::Sensor *sensor) { this->ac_current_b_sensor_ = sensor; }
-  void set_ac_current_c_sensor(sensor::Sensor *sensor) { this->ac_current_c_sensor_ = sensor; }
-  void set_ac_current_total_sensor(sensor::Sensor *sensor) { this->ac_current_total_sensor_ = sensor; }
-  void set_frequency_sensor(sensor::Sensor *sensor) { this->frequency_sensor_ = sensor; }
-  void set_power_factor_sensor(sensor::Sensor *sensor) { this->power_factor_sensor_ = sensor; }
-  void set_total_energy_sensor(sensor::Sensor *sensor) { this->total_energy_sensor_ = sensor; }
-  void set_dc_voltage_sensor(sensor::Sensor *sensor) { this->dc_voltage_sensor_ = sensor; }
-  void set_dc_current_sensor(sensor::Sensor *sensor) { this->dc_current_sensor_ = sensor; }
-  void set_dc_power_sensor(sensor::Sensor *sensor) { this->dc_power_sensor_ = sensor; }
-  void set_temperature_sensor(sensor::Sensor *sensor) { this->temperature_sensor_ = sensor; }
+  void set_power_limit_deadband(float deadband) { this->actuator_.set_deadband(deadband); }
+  void set_power_limit_interval(uint32_t interval) { this->actuator_.set_interval(interval); }
+  // Closed-loop limiting against source AC power: loop bandwidth (Hz), inverter response
+  // time (s) and proportional gain (% rate per % error)
+  void set_closed_loop(float bandwidth, float response_time, float proportional) {
+    this->controller_.configure(bandwidth, response_time, proportional);
+  }
+
+  // Sample history window (bytes of RAM, sample period)
+  void set_history(uint32_t size, uint32_t interval) {
+    this->history_size_ = size;
+    this->history_interval_ = interval;
+  }
+
+  // Diagnostic sensors (server counters)
+  void set_counter_sensor(ServerCounter counter, sensor::Sensor *sensor) { this->counter_sensors_[counter] = sensor; }
+  // Free heap and largest free block (bytes), published with the counters
+  void set_heap_free_sensor(sensor::Sensor *sensor) { this->heap_free_sensor_ = sensor; }
+  void set_heap_largest_block_sensor(sensor::Sensor *sensor) { this->heap_largest_block_sensor_ = sensor; }
+
+  // Latency sensors (µs, over latency_interval_ windows)
+  void set_latency_interval(uint32_t latency_interval) { this->latency_interval_ = latency_interval; }
+  void set_latency_sensor(LatencyMetric metric, LatencyStat stat, sensor::Sensor *sensor) {
+    this->latency_sensors_[metric][stat] = sensor;
+    this->latency_enabled_ = true;
+  }
+  // Band around the commanded limit (percent of max_power) in which the output counts as settled
+  void set_control_tolerance(float tolerance) { this->control_tolerance_ = tolerance; }
+
+  // Serve another instance (with its own sources, nameplate and Model 123 state) from
+  // this instance's TCP server under its unit ID. Call before setup().
+  void add_device(SunSpecModbusServer *device) {
+    this->peers_.push_back(device);
+    device->hosted_ = true;
+  }
+
+  // Model 123 control writes and request timing from the server (always on the main loop)
+  void on_registers_written(uint8_t device, uint16_t reg_start, uint16_t reg_count, uint32_t received_us) override;
+  void on_request_latency(uint32_t us) override { this->latency_[LATENCY_REQUEST].record(us); }
 
  protected:
+  // Registers, history and restored state; runs once, before any server serves this device
+  void prepare_();
+
   // Modbus TCP server
   void start_server_();
-  void handle_client_();
-  void process_request_(WiFiClient &client, uint8_t *buffer, size_t len);
-  void send_response_(WiFiClient &client, uint8_t *request, uint16_t start_addr, uint16_t reg_count);
-  void send_error_(WiFiClient &client, uint8_t *request, uint8_t error_code);
-  void handle_write_single_(WiFiClient &client, uint8_t *buffer);
-  void handle_write_multiple_(WiFiClient &client, uint8_t *buffer, size_t len);
-  void process_write_(uint16_t reg_start, uint16_t reg_count);
+  // Returns true when the write gave the actuator a new target
+  bool handle_control_write_(uint16_t reg_start, uint16_t reg_count);
+  void actuate_power_limit_(uint32_t now);
+  bool close_loop_(uint32_t now, float &output);
+
+  // Control-path tracing into the serving instance's histograms
+  void enable_control_trace_(LatencyHistogram *latency, float tolerance);
+  void start_control_trace_(uint32_t received_us);
+  void on_power_limit_state_(float state);
+  void check_control_trace_();
+
+  // Warm restart
+  void restore_control_state_();
+  PersistedState capture_state_() const;
+  void persist_state_(uint32_t now, bool force);
 
   // SunSpec register management
   void init_registers_();
+  void init_static_registers_();
   void update_registers_();
   void write_string_(uint16_t offset, const char *str, uint16_t max_len);
   void write_uint32_(uint16_t offset, uint32_t value);
 
   // Data sources
+  void subscribe_sources_();
   void update_from_sources_();
+  void derive_values_();
+  void expire_sources_(uint32_t now);
+  // Demand-driven polling: note which fields clients read, then update due pollers
+  void note_demand_(const ModbusTcpServer &server, uint8_t device, uint32_t now);
+  uint32_t poll_period_(const SourcePoller &poller, uint32_t now) const;
+  void run_pollers_(uint32_t now);
+  void refresh_registers_();
   void publish_sensors_();
+  bool publish_due_(const OutputBinding &output, float value, uint32_t now) const;
+  void record_history_();
+  void publish_latency_();
+  void publish_heap_();
+  // Close a timed loop phase: record micros() - mark and restart mark
+  void phase_done_(LatencyMetric metric, uint32_t &mark) {
+    if (!this->latency_enabled_)
+      return;
+    uint32_t now = micros();
+    this->latency_[metric].record(now - mark);
+    mark = now;
+  }
+  void store_(ValueField field, float value) {
+    if (this->values_[field] != value) {
+      this->values_[field] = value;
+      this->dirty_ |= field_bit(field);
+    }
+  }
+  // Store a source state; the field counts as sourced from then on
+  void ingest_(ValueField field, float state) {
+    this->sourced_ |= field_bit(field);
+    this->store_(field, state);
+  }
 
   // Configuration
   uint16_t port_{502};
   uint8_t unit_id_{1};
-  std::string manufacturer_{"Growatt"};
-  std::string model_{"9000 TL3-S"};
-  std::string serial_{"EMULATED001"};
-  std::string version_{"1.0.0"};
+  uint8_t max_clients_{4};
+  uint32_t client_timeout_{30000};
+  const char *manufacturer_{"Growatt"};
+  const char *model_{"9000 TL3-S"};
+  const char *serial_{"EMULATED001"};
+  const char *version_{"1.0.0"};
   uint32_t update_interval_{1000};
+  bool event_driven_{false};
   uint16_t max_power_{9000};
-
-  // Server state
-  WiFiServer *server_{nullptr};
-  WiFiClient client_;
-  bool client_connected_{false};
-  uint32_t last_rx_ms_{0};
-  static const uint32_t CLIENT_TIMEOUT_MS = 30000;  // 30 s without data → force disconnect
+  bool dedicated_task_{false};
+  uint8_t task_core_{1};
+  bool restore_state_{true};
+  uint32_t persist_interval_{600000};
+
+  // Server state: owned (host_) or provided by the instance this one was added to (hosted_)
+  std::unique_ptr<ServerHost> host_;
+  bool hosted_{false};
+  bool prepared_{false};
+  std::vector<SunSpecModbusServer *> peers_;       // added with add_device(), not yet served
+  SunSpecModbusServer *devices_[MAX_DEVICES]{};  // by server device index (this one is 0)
+
+  // Model 123 power limit → power_limit_number_ writes
+  PowerLimitActuator actuator_;
+  PowerLimitController controller_;
+  ControlTrace control_trace_;
+  LatencyHistogram *control_latency_{nullptr};  // null unless the serving instance times latency
+  float control_tolerance_{2.0f};
 
   // Revert timer: restores full power if Victron stops sending commands
   bool revert_active_{false};
   uint32_t revert_deadline_{0};
 
-  // SunSpec registers
-  uint16_t registers_[TOTAL_REGISTERS];
+  // Persisted control state: last saved copy and when it was written
+  ESPPreferenceObject pref_;
+  PersistedState saved_state_{};
+  uint32_t last_persist_{0};
 
-  // Inverter values
-  InverterValues values_;
+  // SunSpec registers (wire order)
+  RegisterImage image_;
+
+  // Inverter values (initialised from FIELD_ENCODINGS)
+  float values_[FIELD_COUNT];
+  uint32_t dirty_{ALL_FIELDS};  // fields changed since the last update_registers_() pass
+  uint32_t sourced_{0};         // fields whose source sensor has delivered a state
+  uint32_t stale_{0};           // fields whose source expired (expire_sources_()) and has not published since
   uint32_t last_update_{0};
 
-  // Output sensors (publish to Home Assistant)
-  sensor::Sensor *ac_power_sensor_{nullptr};
-  sensor::Sensor *ac_voltage_a_sensor_{nullptr};
-  sensor::Sensor *ac_voltage_b_sensor_{nullptr};
-  sensor::Sensor *ac_voltage_c_sensor_{nullptr};
-  sensor::Sensor *ac_current_a_sensor_{nullptr};
-  sensor::Sensor *ac_current_b_sensor_{nullptr};
-  sensor::Sensor *ac_current_c_sensor_{nullptr};
-  sensor::Sensor *ac_current_total_sensor_{nullptr};
-  sensor::Sensor *frequency_sensor_{nullptr};
-  sensor::Sensor *power_factor_sensor_{nullptr};
-  sensor::Sensor *total_energy_sensor_{nullptr};
-  sensor::Sensor *dc_voltage_sensor_{nullptr};
-  sensor::Sensor *dc_current_sensor_{nullptr};
-  sensor::Sensor *dc_power_sensor_{nullptr};
-  sensor::Sensor *temperature_sensor_{nullptr};
+  // Sample history (allocated in setup() when history_size_ > 0)
+  HistoryBuffer history_;
+  uint32_t history_size_{0};
+  uint32_t history_interval_{60000};
+  uint32_t last_history_{0};
+
+  // Latency instrumentation (only timed when a latency sensor is configured)
+  bool latency_enabled_{false};
+  uint32_t latency_interval_{60000};
+  uint32_t last_latency_publish_{0};
+  std::unique_ptr<LatencyHistogram[]> latency_;  // LATENCY_COUNT histograms, null unless latency_enabled_
+
+  // Configured source and output sensors
+  std::vector<FieldBinding> sources_;
+  uint32_t stale_timeout_{0};
+  std::vector<OutputBinding> outputs_;
+
+  // Demand-driven polling: when clients last read each field and their mean read period
+  std::vector<SourcePoller> pollers_;
+  uint32_t last_read_[FIELD_COUNT]{};
+  uint32_t read_period_[FIELD_COUNT]{};
+  uint8_t chunk_reads_seen_[DEMAND_CHUNKS]{};
+  uint32_t suppressed_publishes_{0};
+
+  // Diagnostic and latency sensors
+  sensor::Sensor *suppressed_publishes_sensor_{nullptr};
+  sensor::Sensor *counter_sensors_[COUNTER_COUNT]{};
+  sensor::Sensor *heap_free_sensor_{nullptr};
+  sensor::Sensor *heap_largest_block_sensor_{nullptr};
+  sensor::Sensor *latency_sensors_[LATENCY_COUNT][LATENCY_STAT_COUNT]{};
 
   // Power limit number (target for Growatt active power rate)
   number::Number *power_limit_number_{nullptr};
-
-  // Source sensors (input from external components like modbus_controller)
-  sensor::Sensor *source_ac_power_{nullptr};
-  sensor::Sensor *source_voltage_a_{nullptr};
-  sensor::Sensor *source_voltage_b_{nullptr};
-  sensor::Sensor *source_voltage_c_{nullptr};
-  sensor::Sensor *source_current_a_{nullptr};
-  sensor::Sensor *source_current_b_{nullptr};
-  sensor::Sensor *source_current_c_{nullptr};
-  sensor::Sensor *source_frequency_{nullptr};
-  sensor::Sensor *source_power_factor_{nullptr};
-  sensor::Sensor *source_total_energy_{nullptr};
-  sensor::Sensor *source_dc_voltage_{nullptr};
-  sensor::Sensor *source_dc_current_{nullptr};
-  sensor::Sensor *source_dc_power_{nullptr};
-  sensor::Sensor *source_temperature_{nullptr};
-  sensor::Sensor *source_pv2_voltage_{nullptr};
-  sensor::Sensor *source_pv2_current_{nullptr};
-  sensor::Sensor *source_pv2_power_{nullptr};
-  sensor::Sensor *source_inverter_status_{nullptr};
 };
 
 }  // namespace sunspec_modbus_server
@@ -0,0 +1,69 @@
+#ifdef USE_ARDUINO
+
+#include "wifi_transport.h"
+
+#include <cstdio>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+bool WiFiTransport::begin(uint16_t port, uint8_t max_clients) {
+  this->max_clients_ = max_clients > MAX_CLIENTS_LIMIT ? MAX_CLIENTS_LIMIT : max_clients;
+  this->server_.begin(port);
+  return true;
+}
+
+int WiFiTransport::accept() {
+  if (!this->server_.hasClient())
+    return ACCEPT_NONE;
+
+  for (uint8_t i = 0; i < this->max_clients_; i++) {
+    if (!this->in_use_[i]) {
+      this->clients_[i] = this->server_.accept();
+      this->in_use_[i] = true;
+      return i;
+    }
+  }
+
+  // Table full, reject new one
+  WiFiClient new_client = this->server_.accept();
+  new_client.stop();
+  return ACCEPT_REJECTED;
+}
+
+int WiFiTransport::read(uint8_t slot, uint8_t *buf, size_t len) {
+  WiFiClient &client = this->clients_[slot];
+  int available = client.available();
+  if (available <= 0)
+    return 0;
+  if ((size_t) available < len)
+    len = available;
+  int n = client.read(buf, len);
+  return n > 0 ? n : 0;
+}
+
+size_t WiFiTransport::write(uint8_t slot, const uint8_t *data, size_t len) {
+  WiFiClient &client = this->clients_[slot];
+  size_t sent = client.write(data, len);
+  // WiFiClient::write() has already retried until its timeout. A partial frame would
+  // desynchronize the stream for good, so drop the connection; the core then sees
+  // !connected(), skips further responses and closes the slot.
+  if (sent < len)
+    client.stop();
+  return sent;
+}
+
+void WiFiTransport::close(uint8_t slot) {
+  this->clients_[slot].stop();
+  this->in_use_[slot] = false;
+}
+
+void WiFiTransport::get_remote_address(uint8_t slot, char *buf, size_t len) {
+  IPAddress ip = this->clients_[slot].remoteIP();
+  snprintf(buf, len, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // USE_ARDUINO
@@ -0,0 +1,37 @@
+#pragma once
+
+#ifdef USE_ARDUINO
+
+#include "modbus_transport.h"
+
+#ifdef USE_ESP32
+#include <WiFi.h>
+#elif defined(USE_ESP8266)
+#include <ESP8266WiFi.h>
+#endif
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Arduino WiFiServer/WiFiClient backend (ESP32 and ESP8266)
+class WiFiTransport : public ModbusTransport {
+ public:
+  bool begin(uint16_t port, uint8_t max_clients) override;
+  int accept() override;
+  bool connected(uint8_t slot) override { return this->in_use_[slot] && this->clients_[slot].connected(); }
+  int read(uint8_t slot, uint8_t *buf, size_t len) override;
+  size_t write(uint8_t slot, const uint8_t *data, size_t len) override;
+  void close(uint8_t slot) override;
+  void get_remote_address(uint8_t slot, char *buf, size_t len) override;
+
+ protected:
+  WiFiServer server_{0};  // port is set in begin()
+  WiFiClient clients_[MAX_CLIENTS_LIMIT];
+  bool in_use_[MAX_CLIENTS_LIMIT]{};
+  uint8_t max_clients_{0};
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
+
+#endif  // USE_ARDUINO
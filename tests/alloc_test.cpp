@@ -0,0 +1,92 @@
+// Steady-state allocation test: built with SUNSPEC_ALLOCATION_CHECK, so operator new
+// is counted per thread (alloc_check.cpp). After setup, a client connects, polls with
+// FC03, writes with FC06/FC16, reads the diagnostic and history windows and
+// disconnects; thread_allocations() must not move, and every response is checked so
+// the requests really took the paths being measured.
+
+#include "alloc_check.h"
+#include "frames.h"
+#include "modbus_tcp_server.h"
+#include "stub_transport.h"
+
+#include <cstdio>
+#include <memory>
+
+using namespace esphome::sunspec_modbus_server;
+
+static const uint8_t UNIT = 126;
+static const uint16_t MODEL103_ADDRESS = SUNSPEC_BASE_ADDRESS + MODEL103_ID_OFFSET;
+static const uint16_t WMAXLIMPCT_ADDRESS = SUNSPEC_BASE_ADDRESS + MODEL123_DATA_OFFSET + Model123::WMaxLimPct;
+
+static StubTransport transport;
+static RegisterImage image;
+static HistoryBuffer history;
+static ModbusTcpServer server;
+static uint32_t now = 0;
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Send one request and run the server until it has answered; returns the function
+// code of the response (exception bit included)
+static uint8_t request(const uint8_t *frame, size_t len, size_t response_len) {
+  transport.clear_output(0);
+  transport.send(0, frame, len);
+  server.loop(++now);
+  if (transport.output_len(0) != response_len)
+    return 0;
+  return transport.output(0)[7];
+}
+
+int main() {
+  // Setup may allocate (the history ring is allocated here, as in setup())
+  history.init(2 * HistoryBuffer::BLOCK_SIZE, 1000);
+  server.set_transport(&transport);
+  server.add_device(UNIT, &image, &history);
+  server.begin(502);
+
+  // The counter must see allocations, or the test below proves nothing
+  uint32_t before = thread_allocations();
+  std::unique_ptr<int> probe(new int(0));
+  expect(thread_allocations() == before + 1, "operator new is counted");
+
+  uint32_t start = thread_allocations();
+  uint8_t frame[260];
+  size_t len;
+
+  transport.connect();
+  server.loop(++now);
+  expect(transport.connected(0), "client accepted");
+
+  for (uint16_t n = 0; n < 100; n++) {
+    len = read_request(frame, n, UNIT, 0x03, MODEL103_ADDRESS, MODEL103_LENGTH + MODEL_HEADER_LENGTH);
+    expect(request(frame, len, 9 + (MODEL103_LENGTH + MODEL_HEADER_LENGTH) * 2) == 0x03, "FC03 Model 103");
+
+    len = write_single_request(frame, n, UNIT, WMAXLIMPCT_ADDRESS, 50 + n % 50);
+    expect(request(frame, len, 12) == 0x06, "FC06 WMaxLimPct");
+
+    const uint16_t values[3] = {(uint16_t) (40 + n % 60), 0, 60};
+    len = write_multiple_request(frame, n, UNIT, WMAXLIMPCT_ADDRESS, values, 3);
+    expect(request(frame, len, 12) == 0x10, "FC16 WMaxLimPct + timers");
+  }
+
+  len = read_request(frame, 1, UNIT, 0x03, SUNSPEC_BASE_ADDRESS + DIAG_OFFSET, DIAG_LENGTH);
+  expect(request(frame, len, 9 + DIAG_LENGTH * 2) == 0x03, "FC03 diagnostic block");
+  len = read_request(frame, 2, UNIT, 0x03, SUNSPEC_BASE_ADDRESS + HISTORY_OFFSET, HistoryBuffer::HEADER_REGISTERS);
+  expect(request(frame, len, 9 + HistoryBuffer::HEADER_REGISTERS * 2) == 0x03, "FC03 history header");
+  len = read_request(frame, 3, UNIT, 0x03, SUNSPEC_BASE_ADDRESS + DIAG_OFFSET + DIAG_LENGTH, 1);
+  expect(request(frame, len, 9) == 0x83, "FC03 out of range → exception");
+
+  transport.close(0);
+  server.loop(++now);
+
+  uint32_t allocations = thread_allocations() - start;
+  expect(allocations == 0, "no heap allocation after setup");
+  printf("%u allocation(s) after setup, %d failure(s)\n", (unsigned) allocations, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+// Request throughput of the protocol core on the host: GX-style FC03/FC06/FC16
+// frames pushed through StubTransport and ModbusTcpServer::loop(), 16 pipelined
+// requests per loop, with every response checked for length. Prints frames per
+// second per function code. Numbers are for comparing changes on one machine; the
+// ESP32 is roughly two orders of magnitude slower.
+//
+//   bench_requests [frames per function code, default 1000000]
+
+#include "frames.h"
+#include "modbus_tcp_server.h"
+#include "stub_transport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace esphome::sunspec_modbus_server;
+
+static const uint8_t UNIT = 126;
+static const uint16_t MODEL103_ADDRESS = SUNSPEC_BASE_ADDRESS + MODEL103_ID_OFFSET;
+static const uint16_t WMAXLIMPCT_ADDRESS = SUNSPEC_BASE_ADDRESS + MODEL123_DATA_OFFSET + Model123::WMaxLimPct;
+static const uint8_t BATCH = 16;
+
+struct Case {
+  const char *name;
+  size_t response_len;
+  // Build request number n into buf
+  size_t (*build)(uint8_t *buf, uint32_t n);
+};
+
+static size_t build_read(uint8_t *buf, uint32_t n) {
+  return read_request(buf, n, UNIT, 0x03, MODEL103_ADDRESS, MODEL103_LENGTH + MODEL_HEADER_LENGTH);
+}
+
+static size_t build_write_single(uint8_t *buf, uint32_t n) {
+  return write_single_request(buf, n, UNIT, WMAXLIMPCT_ADDRESS, 50 + n % 50);
+}
+
+static size_t build_write_multiple(uint8_t *buf, uint32_t n) {
+  // WMaxLimPct, WinTms, RvrtTms, as the GX writes them
+  const uint16_t values[3] = {(uint16_t) (50 + n % 50), 0, 60};
+  return write_multiple_request(buf, n, UNIT, WMAXLIMPCT_ADDRESS, values, 3);
+}
+
+static const Case CASES[] = {
+    {"FC03 read Model 103", 9 + (MODEL103_LENGTH + MODEL_HEADER_LENGTH) * 2, build_read},
+    {"FC06 write WMaxLimPct", 12, build_write_single},
+    {"FC16 write WMaxLimPct + timers", 12, build_write_multiple},
+};
+
+int main(int argc, char **argv) {
+  uint32_t frames = argc > 1 ? (uint32_t) strtoul(argv[1], nullptr, 10) : 1000000;
+  if (frames == 0) {
+    fprintf(stderr, "usage: %s [frames per function code]\n", argv[0]);
+    return 2;
+  }
+
+  static StubTransport transport;
+  static RegisterImage image;
+  static ModbusTcpServer server;
+  server.set_transport(&transport);
+  server.add_device(UNIT, &image);
+  server.begin(502);
+  transport.connect();
+  uint32_t now = 0;
+  server.loop(now);
+
+  for (const Case &test : CASES) {
+    uint8_t frame[260];
+    uint32_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (sent < frames) {
+      uint8_t batch = frames - sent < BATCH ? frames - sent : BATCH;
+      for (uint8_t i = 0; i < batch; i++) {
+        size_t len = test.build(frame, sent + i);
+        transport.send(0, frame, len);
+      }
+      server.loop(++now);
+      if (transport.output_len(0) != batch * test.response_len || transport.pending_input(0) != 0) {
+        fprintf(stderr, "%s: unexpected response (%zu bytes for %u requests)\n", test.name, transport.output_len(0),
+                batch);
+        return 1;
+      }
+      transport.clear_output(0);
+      sent += batch;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-32s %10.0f frames/s\n", test.name, frames / seconds);
+  }
+  return 0;
+}
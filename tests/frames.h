@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// Modbus TCP request builders for host tests. Each writes one ADU into buf and
+// returns its length; buf must hold 260 bytes.
+
+inline size_t mbap_frame(uint8_t *buf, uint16_t transaction, uint8_t unit, size_t pdu_len) {
+  size_t length = pdu_len + 1;  // unit ID + PDU
+  buf[0] = transaction >> 8;
+  buf[1] = transaction & 0xFF;
+  buf[2] = 0;
+  buf[3] = 0;
+  buf[4] = length >> 8;
+  buf[5] = length & 0xFF;
+  buf[6] = unit;
+  return 6 + length;
+}
+
+inline void put_be16(uint8_t *dest, uint16_t value) {
+  dest[0] = value >> 8;
+  dest[1] = value & 0xFF;
+}
+
+// FC03/FC04
+inline size_t read_request(uint8_t *buf, uint16_t transaction, uint8_t unit, uint8_t function_code, uint16_t address,
+                           uint16_t quantity) {
+  buf[7] = function_code;
+  put_be16(buf + 8, address);
+  put_be16(buf + 10, quantity);
+  return mbap_frame(buf, transaction, unit, 5);
+}
+
+// FC06
+inline size_t write_single_request(uint8_t *buf, uint16_t transaction, uint8_t unit, uint16_t address,
+                                   uint16_t value) {
+  buf[7] = 0x06;
+  put_be16(buf + 8, address);
+  put_be16(buf + 10, value);
+  return mbap_frame(buf, transaction, unit, 5);
+}
+
+// FC16
+inline size_t write_multiple_request(uint8_t *buf, uint16_t transaction, uint8_t unit, uint16_t address,
+                                     const uint16_t *values, uint8_t count) {
+  buf[7] = 0x10;
+  put_be16(buf + 8, address);
+  put_be16(buf + 10, count);
+  buf[12] = count * 2;
+  for (uint8_t i = 0; i < count; i++)
+    put_be16(buf + 13 + i * 2, values[i]);
+  return mbap_frame(buf, transaction, unit, 6 + count * 2);
+}
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
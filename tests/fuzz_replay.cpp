@@ -0,0 +1,45 @@
+// Stand-in for libFuzzer's driver when the compiler has no -fsanitize=fuzzer (GCC):
+// runs LLVMFuzzerTestOneInput once per file, for files and directories given on the
+// command line. ctest uses it to replay the seed corpus on every build.
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static bool run_file(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Cannot read %s\n", path.c_str());
+    return false;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  LLVMFuzzerTestOneInput(data.data(), data.size());
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t runs = 0;
+  for (int i = 1; i < argc; i++) {
+    std::filesystem::path path(argv[i]);
+    if (std::filesystem::is_directory(path)) {
+      for (const auto &entry : std::filesystem::directory_iterator(path)) {
+        if (!entry.is_regular_file())
+          continue;
+        if (!run_file(entry.path()))
+          return 1;
+        runs++;
+      }
+    } else if (run_file(path)) {
+      runs++;
+    } else {
+      return 1;
+    }
+  }
+  printf("Replayed %zu input(s)\n", runs);
+  return runs > 0 ? 0 : 1;
+}
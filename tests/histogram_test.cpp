@@ -0,0 +1,50 @@
+// LatencyHistogram: percentiles stay within a half-octave of the recorded values over
+// the whole range, including control traces close to their 60 s timeout.
+
+#include "histogram.h"
+
+#include <cstdio>
+#include <initializer_list>
+
+using namespace esphome::sunspec_modbus_server;
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// The reported percentile is the bucket's upper bound: at most ~50 % above the value
+static bool near(uint32_t reported, uint32_t value) { return reported >= value && reported <= value + value / 2; }
+
+int main() {
+  LatencyHistogram histogram;
+  for (uint32_t value : {150u, 2500u, 1000000u, 16000000u, 25000000u, 59000000u}) {
+    histogram.reset();
+    for (int i = 0; i < 100; i++)
+      histogram.record(value);
+    expect(near(histogram.percentile(50), value) && near(histogram.percentile(99), value), "percentile of a constant");
+    expect(histogram.max() == value, "max is exact");
+  }
+
+  // A slow settle among fast ones shows up in p99, not capped at ~16.8 s
+  histogram.reset();
+  for (int i = 0; i < 98; i++)
+    histogram.record(3000000);
+  for (int i = 0; i < 2; i++)
+    histogram.record(45000000);
+  expect(near(histogram.percentile(50), 3000000), "p50 of mostly fast settles");
+  expect(near(histogram.percentile(99), 45000000), "p99 reaches a 45 s settle");
+
+  // Beyond the range percentiles stop at its end; only max() is exact
+  histogram.reset();
+  histogram.record(LatencyHistogram::RANGE_US * 2);
+  expect(histogram.percentile(50) == LatencyHistogram::RANGE_US - 1, "out of range capped at the range end");
+  expect(histogram.max() == LatencyHistogram::RANGE_US * 2, "out of range max is exact");
+
+  printf("%d failure(s)\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+// PowerLimitController against a simulated inverter, plus the arithmetic edge cases.
+//
+// Plant: a 9 kW inverter whose output follows min(rate · gain · 9 kW, sun) as an
+// underdamped second-order system (ωn 0.8 rad/s, ζ 0.5). A rate takes 300 ms over
+// RS485 to arrive, and AC power is polled once a second, as with a Growatt behind
+// modbus_controller. The loop runs every 20 ms and mirrors actuate_power_limit_() /
+// close_loop_(): PowerLimitActuator paces the writes to one per second.
+//
+// Scenario: full sun, a 40 % limit at 2 s, a cloud (sun-limited at 2 kW) at 70 s,
+// full sun again at 90 s. gain is how far the inverter's rate is off: 1.0 is exact,
+// 0.9 and 1.1 are what open loop gets wrong and the controller must remove.
+
+#include "power_actuator.h"
+#include "power_controller.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+
+using namespace esphome::sunspec_modbus_server;
+
+static const float MAX_POWER = 9000.0f;
+static const float LIMIT_PCT = 40.0f;
+static const float LIMIT_W = LIMIT_PCT / 100.0f * MAX_POWER;
+static const float BAND_W = 0.02f * MAX_POWER;  // settled: within ±2 % of max_power
+static const uint32_t STEP_MS = 20;
+static const uint32_t RTU_DELAY_MS = 300;
+static const uint32_t POLL_MS = 1000;
+static const float CLOSED_LOOP_MIN_STEP = 0.5f;  // as in sunspec_server.cpp
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+struct Result {
+  float peak;         // largest deviation from the limit once the output first reached the band
+  float settle_s;     // time after the limit step from which the output stays in the band (-1: never)
+  float error;        // steady-state deviation just before the cloud
+  float sun_return;   // largest overshoot above the limit after the cloud
+};
+
+static Result simulate(bool closed, float gain, float proportional) {
+  PowerLimitActuator actuator;
+  actuator.set_interval(POLL_MS);
+  PowerLimitController controller;
+  if (closed)
+    controller.configure(0.02f, 3.0f, proportional);  // the YAML defaults, apart from proportional
+
+  float power = 8000.0f, velocity = 0.0f, sun = 8500.0f;
+  float rate = 100.0f, pending = 100.0f, measured = power;
+  uint32_t pending_at = 0;
+  bool entered = false;
+  int32_t settled_at = -1;
+  Result result{0.0f, -1.0f, 0.0f, 0.0f};
+
+  for (uint32_t t = 0; t < 120000; t += STEP_MS) {
+    uint32_t now = 1000 + t;
+    if (t == 2000)
+      actuator.command(LIMIT_PCT, 0, now);
+    if (t == 70000)
+      sun = 2000.0f;
+    if (t == 90000)
+      sun = 8500.0f;
+
+    float value;
+    bool write;
+    if (closed) {
+      float output = 100.0f;
+      if (actuator.has_target()) {
+        float reference = actuator.reference(now);
+        if (reference >= 100.0f) {
+          controller.reset();
+          output = reference;
+        } else {
+          output = controller.update(reference, measured * 100.0f / MAX_POWER, now);
+        }
+      }
+      write = actuator.has_target() && actuator.pace(output, now, CLOSED_LOOP_MIN_STEP);
+      value = output;
+    } else {
+      write = actuator.update(now, value);
+    }
+    if (write) {
+      pending = value;
+      pending_at = now + RTU_DELAY_MS;
+    }
+    if (pending_at != 0 && now >= pending_at) {
+      rate = pending;
+      pending_at = 0;
+    }
+
+    float target = std::fmin(rate / 100.0f * MAX_POWER * gain, sun);
+    float dt = STEP_MS / 1000.0f, wn = 0.8f, zeta = 0.5f;
+    velocity += (wn * wn * (target - power) - 2.0f * zeta * wn * velocity) * dt;
+    power += velocity * dt;
+    if (power < 0.0f) {
+      power = 0.0f;
+      velocity = 0.0f;
+    }
+    if (t % POLL_MS == 0)
+      measured = roundf(power);
+
+    float deviation = power - LIMIT_W;
+    if (t > 2000 && t < 70000) {
+      if (deviation <= BAND_W)
+        entered = true;
+      if (entered && fabsf(deviation) > result.peak)
+        result.peak = fabsf(deviation);
+      if (fabsf(deviation) > BAND_W)
+        settled_at = -1;
+      else if (settled_at < 0)
+        settled_at = (int32_t) (t - 2000);
+    }
+    if (t == 69000)
+      result.error = deviation;
+    if (t >= 90000 && deviation > result.sun_return)
+      result.sun_return = deviation;
+  }
+  result.settle_s = settled_at < 0 ? -1.0f : settled_at / 1000.0f;
+  printf("%s gain %.1f kp %.1f: peak %4.0f W, settled after %5.1f s, error %5.0f W, sun-return overshoot %4.0f W\n",
+         closed ? "closed" : "open  ", gain, proportional, result.peak, result.settle_s, result.error,
+         result.sun_return);
+  return result;
+}
+
+static void test_plant() {
+  // An exact inverter: the controller has nothing to correct and must not make it worse
+  Result open = simulate(false, 1.0f, 0.0f);
+  Result closed = simulate(true, 1.0f, 0.0f);
+  expect(closed.settle_s >= 0.0f && closed.settle_s <= 10.0f, "gain 1.0: settles within 10 s");
+  expect(closed.peak <= open.peak + 50.0f, "gain 1.0: no more overshoot than open loop");
+
+  // Rate off by ±10 %: open loop stays off, closed loop removes the error
+  for (float gain : {0.9f, 1.1f}) {
+    open = simulate(false, gain, 0.0f);
+    closed = simulate(true, gain, 0.0f);
+    expect(fabsf(open.error) > BAND_W, "open loop keeps the rate error");
+    expect(closed.settle_s >= 0.0f && closed.settle_s <= 25.0f, "closed loop settles within 25 s");
+    expect(fabsf(closed.error) <= 0.01f * MAX_POWER, "closed loop steady-state error within 1 %");
+    expect(closed.peak <= open.peak + 50.0f, "closed loop adds no overshoot to the limit step");
+    // Anti-windup: the sun-limited cloud must not leave an integral behind. The plant
+    // alone overshoots ~260 W on the sun's return; open loop at gain 1.1 reaches ~680 W
+    expect(closed.sun_return <= 400.0f, "no windup overshoot when the sun returns");
+  }
+
+  // Proportional action only adds overshoot with 1 s measurement and write pacing,
+  // which is why proportional_gain defaults to 0
+  Result integral_only = simulate(true, 1.0f, 0.0f);
+  Result with_p = simulate(true, 1.0f, 0.3f);
+  expect(with_p.peak > integral_only.peak, "proportional gain increases overshoot");
+}
+
+static void test_arithmetic() {
+  PowerLimitController controller;
+  controller.configure(0.02f, 3.0f, 0.0f);
+
+  // Matching measurement: the output is the reference, to Q16.16 precision
+  float output = 0.0f;
+  for (uint32_t now = 0; now <= 10000; now += 100)
+    output = controller.update(40.0f, 40.0f, now);
+  expect(fabsf(output - 40.0f) < 0.001f, "no correction without an error");
+
+  // Sun-limited for an hour: the error is beyond the trim band, so nothing integrates
+  controller.reset();
+  for (uint32_t now = 0; now <= 3600000; now += 1000)
+    output = controller.update(40.0f, 10.0f, now);
+  expect(output <= 45.0f + 0.001f, "output never exceeds the reference by more than 5 %");
+  expect(fabsf(controller.update(40.0f, 40.0f, 3601000) - 40.0f) < 0.001f, "no windup while sun-limited");
+
+  // A persistent small error integrates up to the trim limit and no further
+  controller.reset();
+  for (uint32_t now = 0; now <= 600000; now += 1000)
+    output = controller.update(40.0f, 37.0f, now);
+  expect(output <= 45.0f + 0.001f && output > 40.0f, "integral bounded by the trim band");
+
+  // Full-scale values, a clock wrap and a long stall stay in range
+  controller.configure(1.0f, 0.1f, 2.0f);
+  uint32_t now = UINT32_MAX - 500;
+  for (int i = 0; i < 20; i++, now += 250) {
+    output = controller.update(i % 2 ? 100.0f : 0.0f, i % 2 ? 0.0f : 100.0f, now);
+    expect(output >= 0.0f && output <= 100.0f, "output within 0-100 % at full scale");
+  }
+  output = controller.update(50.0f, 48.0f, now + 3600000);
+  expect(output >= 0.0f && output <= 55.0f, "a stalled loop counts as one second");
+}
+
+int main() {
+  test_plant();
+  test_arithmetic();
+  printf("%d failure(s)\n", failures);
+  return failures == 0 ? 0 : 1;
+}
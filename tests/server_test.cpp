@@ -0,0 +1,96 @@
+// Protocol behaviour of ModbusTcpServer through StubTransport: what is answered,
+// what is dropped silently, and what happens to a connection.
+
+#include "frames.h"
+#include "modbus_tcp_server.h"
+#include "stub_transport.h"
+
+#include <cstdio>
+
+using namespace esphome::sunspec_modbus_server;
+
+static const uint8_t UNIT = 126;
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// A server hosting one device, with a client connected in slot 0
+struct Fixture {
+  Fixture() {
+    this->server.set_transport(&this->transport);
+    this->server.add_device(UNIT, &this->image);
+    this->server.begin(502);
+    this->transport.connect();
+    this->server.loop(++this->now);
+  }
+
+  StubTransport transport;
+  RegisterImage image;
+  ModbusTcpServer server;
+  uint32_t now{0};
+};
+
+static void test_short_foreign_frames_dropped() {
+  static Fixture f;
+  uint8_t frame[260];
+
+  // MBAP + FC only: too short for FC03, but not ours, so no exception either
+  size_t len = mbap_frame(frame, 1, UNIT + 1, 1);
+  frame[7] = 0x03;
+  f.transport.send(0, frame, len);
+  f.server.loop(++f.now);
+  expect(f.transport.output_len(0) == 0, "short frame for a foreign unit is dropped");
+
+  len = mbap_frame(frame, 2, UNIT, 1);
+  frame[2] = 0x12;  // protocol ID
+  f.transport.send(0, frame, len);
+  f.server.loop(++f.now);
+  expect(f.transport.output_len(0) == 0, "short frame with a foreign protocol ID is dropped");
+  expect(f.server.get_counter(COUNTER_DROPPED_PROTOCOL) == 1 && f.server.get_counter(COUNTER_DROPPED_UNIT) == 1,
+         "dropped short frames are counted");
+
+  // The same short frame for our unit gets exception 03
+  len = mbap_frame(frame, 3, UNIT, 1);
+  f.transport.send(0, frame, len);
+  f.server.loop(++f.now);
+  expect(f.transport.output_len(0) == 9 && f.transport.output(0)[7] == 0x83 && f.transport.output(0)[8] == 0x03,
+         "short frame for our unit gets exception 03");
+}
+
+static void test_half_close_applies_buffered_writes() {
+  static Fixture f;
+  uint8_t frame[260];
+  const uint16_t limit = MODEL123_DATA_OFFSET + Model123::WMaxLimPct;
+
+  // Two pipelined writes, then the client half-closes before the server ran
+  size_t len = write_single_request(frame, 1, UNIT, SUNSPEC_BASE_ADDRESS + limit, 40);
+  f.transport.send(0, frame, len);
+  const uint16_t values[2] = {1, 0};
+  len = write_multiple_request(frame, 2, UNIT, SUNSPEC_BASE_ADDRESS + limit + 4, values, 2);
+  f.transport.send(0, frame, len);
+  f.transport.shutdown(0);
+  f.server.loop(++f.now);
+
+  expect(f.image.get(limit) == 40, "FC06 before the half-close is applied");
+  expect(f.image.get(limit + 4) == 1, "FC16 before the half-close is applied");
+  expect(f.transport.output_len(0) == 0, "no response is written to a closed peer");
+  expect(f.server.get_counter(COUNTER_BYTES_OUT) == 0, "skipped responses are not counted as sent");
+
+  // The slot was released and takes the next client
+  f.transport.connect();
+  f.server.loop(++f.now);
+  expect(f.transport.connected(0), "slot reused after the half-close");
+}
+
+int main() {
+  test_short_foreign_frames_dropped();
+  test_half_close_applies_buffered_writes();
+  printf("%d failure(s)\n", failures);
+  return failures == 0 ? 0 : 1;
+}
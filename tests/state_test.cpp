@@ -0,0 +1,70 @@
+// SunSpecModbusServer on the host: the Model 103 operating state as sources come and
+// go. The stub clock is advanced instead of sleeping through stale_timeout.
+
+#include "sunspec_server.h"
+
+#include <cstdio>
+
+using namespace esphome;
+using namespace esphome::sunspec_modbus_server;
+
+static const uint32_t STALE_TIMEOUT = 5000;
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Exposes the register image the TCP server would serve
+class TestServer : public SunSpecModbusServer {
+ public:
+  uint16_t operating_state() const { return this->image_.get(MODEL103_DATA_OFFSET + Model103::St); }
+};
+
+static void test_stale_ac_power() {
+  sensor::Sensor ac_power("ac_power"), status("inverter_status");
+  TestServer server;
+  server.set_port(0);
+  server.set_update_interval(0);  // every loop() is an update pass
+  server.set_restore_state(false);
+  server.set_stale_timeout(STALE_TIMEOUT);
+  server.add_source(FIELD_AC_POWER, &ac_power);
+  server.add_source(FIELD_INVERTER_STATUS, &status);
+  server.setup();
+
+  ac_power.publish_state(3000.0f);
+  status.publish_state(1.0f);
+  server.loop();
+  expect(server.operating_state() == (uint16_t) InverterState::MPPT, "both sources live: MPPT");
+
+  // RS485 reads of the power register fail while the status keeps arriving
+  for (int i = 0; i < 2; i++) {
+    advance_clock(STALE_TIMEOUT / 2 + 1);
+    status.publish_state(1.0f);
+    server.loop();
+  }
+  expect(server.operating_state() == (uint16_t) InverterState::FAULT, "AC power stale, status live: FAULT");
+
+  ac_power.publish_state(2500.0f);
+  server.loop();
+  expect(server.operating_state() == (uint16_t) InverterState::MPPT, "AC power back: MPPT again");
+
+  // The inverter is gone altogether
+  advance_clock(STALE_TIMEOUT + 1);
+  server.loop();
+  expect(server.operating_state() == (uint16_t) InverterState::OFF, "all sources stale: OFF");
+
+  ac_power.publish_state(1000.0f);
+  server.loop();
+  expect(server.operating_state() == (uint16_t) InverterState::MPPT, "AC power back without status: MPPT");
+}
+
+int main() {
+  test_stale_ac_power();
+  printf("%d failure(s)\n", failures);
+  return failures == 0 ? 0 : 1;
+}
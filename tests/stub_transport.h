@@ -0,0 +1,92 @@
+#pragma once
+
+#include "modbus_transport.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace esphome {
+namespace sunspec_modbus_server {
+
+// In-memory ModbusTransport for host tests: the test plays the client side with
+// connect()/send()/take(), the server core sees ordinary non-blocking slots. Buffers
+// are fixed arrays, so the transport itself never allocates.
+class StubTransport : public ModbusTransport {
+ public:
+  static const size_t BUFFER_SIZE = 4096;
+
+  bool begin(uint16_t port, uint8_t max_clients) override {
+    this->max_clients_ = max_clients > MAX_CLIENTS_LIMIT ? MAX_CLIENTS_LIMIT : max_clients;
+    return true;
+  }
+  int accept() override {
+    if (this->pending_ == 0)
+      return ACCEPT_NONE;
+    this->pending_--;
+    for (uint8_t slot = 0; slot < this->max_clients_; slot++) {
+      if (!this->open_[slot]) {
+        this->open_[slot] = true;
+        this->in_len_[slot] = 0;
+        this->in_pos_[slot] = 0;
+        this->out_len_[slot] = 0;
+        this->peer_closed_[slot] = false;
+        return slot;
+      }
+    }
+    return ACCEPT_REJECTED;
+  }
+  bool connected(uint8_t slot) override { return this->open_[slot] && !this->peer_closed_[slot]; }
+  int read(uint8_t slot, uint8_t *buf, size_t len) override {
+    size_t available = this->in_len_[slot] - this->in_pos_[slot];
+    if (len > available)
+      len = available;
+    memcpy(buf, this->in_[slot] + this->in_pos_[slot], len);
+    this->in_pos_[slot] += len;
+    if (this->in_pos_[slot] == this->in_len_[slot])
+      this->in_pos_[slot] = this->in_len_[slot] = 0;
+    return (int) len;
+  }
+  size_t write(uint8_t slot, const uint8_t *data, size_t len) override {
+    size_t space = BUFFER_SIZE - this->out_len_[slot];
+    if (len > space)
+      len = space;
+    memcpy(this->out_[slot] + this->out_len_[slot], data, len);
+    this->out_len_[slot] += len;
+    return len;
+  }
+  void close(uint8_t slot) override { this->open_[slot] = false; }
+  void get_remote_address(uint8_t slot, char *buf, size_t len) override { snprintf(buf, len, "stub:%u", slot); }
+
+  // Client side: queue a connection for the next accept()
+  void connect() { this->pending_++; }
+  // Half-close from the client: bytes already sent stay readable, connected() turns false
+  void shutdown(uint8_t slot) { this->peer_closed_[slot] = true; }
+  // Queue request bytes for slot; false if they don't fit
+  bool send(uint8_t slot, const uint8_t *data, size_t len) {
+    if (len > BUFFER_SIZE - this->in_len_[slot])
+      return false;
+    memcpy(this->in_[slot] + this->in_len_[slot], data, len);
+    this->in_len_[slot] += len;
+    return true;
+  }
+  // Everything the server wrote to slot since the last clear_output()
+  const uint8_t *output(uint8_t slot) const { return this->out_[slot]; }
+  size_t output_len(uint8_t slot) const { return this->out_len_[slot]; }
+  void clear_output(uint8_t slot) { this->out_len_[slot] = 0; }
+  // Request bytes the server has not read yet
+  size_t pending_input(uint8_t slot) const { return this->in_len_[slot] - this->in_pos_[slot]; }
+
+ protected:
+  uint8_t max_clients_{0};
+  uint8_t pending_{0};
+  bool open_[MAX_CLIENTS_LIMIT]{};
+  bool peer_closed_[MAX_CLIENTS_LIMIT]{};
+  uint8_t in_[MAX_CLIENTS_LIMIT][BUFFER_SIZE];
+  size_t in_len_[MAX_CLIENTS_LIMIT]{};
+  size_t in_pos_[MAX_CLIENTS_LIMIT]{};
+  uint8_t out_[MAX_CLIENTS_LIMIT][BUFFER_SIZE];
+  size_t out_len_[MAX_CLIENTS_LIMIT]{};
+};
+
+}  // namespace sunspec_modbus_server
+}  // namespace esphome
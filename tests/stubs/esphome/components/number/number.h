@@ -0,0 +1,51 @@
+#pragma once
+
+// Host test stand-in for ESPHome's number: an optimistic number that publishes every
+// value it is set to
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace esphome {
+namespace number {
+
+class Number;
+
+class NumberCall {
+ public:
+  explicit NumberCall(Number *parent) : parent_(parent) {}
+  NumberCall &set_value(float value) {
+    this->value_ = value;
+    return *this;
+  }
+  void perform();
+
+ protected:
+  Number *parent_;
+  float value_{0.0f};
+};
+
+class Number {
+ public:
+  NumberCall make_call() { return NumberCall(this); }
+  void publish_state(float state) {
+    this->state = state;
+    this->has_state_ = true;
+    for (auto &callback : this->callbacks_)
+      callback(state);
+  }
+  void add_on_state_callback(std::function<void(float)> &&callback) { this->callbacks_.push_back(std::move(callback)); }
+  bool has_state() const { return this->has_state_; }
+
+  float state{0.0f};
+
+ protected:
+  bool has_state_{false};
+  std::vector<std::function<void(float)>> callbacks_;
+};
+
+inline void NumberCall::perform() { this->parent_->publish_state(this->value_); }
+
+}  // namespace number
+}  // namespace esphome
@@ -0,0 +1,35 @@
+#pragma once
+
+// Host test stand-in for ESPHome's component.h: the lifecycle is driven by the test
+
+#include "esphome/core/hal.h"
+
+namespace esphome {
+
+namespace setup_priority {
+static const float AFTER_WIFI = 250.0f;
+}  // namespace setup_priority
+
+class Component {
+ public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void loop() {}
+  virtual void dump_config() {}
+  virtual void on_shutdown() {}
+  virtual float get_setup_priority() const { return 0.0f; }
+
+  void mark_failed() { this->failed_ = true; }
+  bool is_failed() const { return this->failed_; }
+
+ protected:
+  bool failed_{false};
+};
+
+class PollingComponent : public Component {
+ public:
+  virtual void update() = 0;
+  void stop_poller() {}
+};
+
+}  // namespace esphome
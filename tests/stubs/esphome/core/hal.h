@@ -0,0 +1,26 @@
+#pragma once
+
+// Host test stand-in for ESPHome's hal.h: only the clocks the component uses. Tests
+// can move both forward with advance_clock() instead of sleeping.
+
+#include <chrono>
+#include <cstdint>
+
+namespace esphome {
+
+inline uint64_t &clock_offset_us() {
+  static uint64_t offset = 0;
+  return offset;
+}
+
+inline void advance_clock(uint32_t ms) { clock_offset_us() += (uint64_t) ms * 1000; }
+
+inline uint64_t clock_us() {
+  using namespace std::chrono;
+  return (uint64_t) duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() + clock_offset_us();
+}
+
+inline uint32_t millis() { return (uint32_t) (clock_us() / 1000); }
+inline uint32_t micros() { return (uint32_t) clock_us(); }
+
+}  // namespace esphome
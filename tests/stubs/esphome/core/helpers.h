@@ -0,0 +1,22 @@
+#pragma once
+
+// Host test stand-in for ESPHome's helpers.h
+
+#include <cstdint>
+#include <string>
+
+#define YESNO(b) ((b) ? "YES" : "NO")
+
+namespace esphome {
+
+// FNV-1 as in ESPHome, for preference keys
+inline uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= (uint8_t) c;
+  }
+  return hash;
+}
+
+}  // namespace esphome
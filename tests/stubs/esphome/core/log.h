@@ -0,0 +1,25 @@
+#pragma once
+
+// Host test stand-in for ESPHome's log.h. Errors go to stderr; everything else is
+// compiled (so format strings are still checked) but not printed, which keeps fuzzing
+// and benchmark runs quiet.
+
+#include <cstdio>
+
+#define ESP_LOG_QUIET_(tag, ...) \
+  do { \
+    if (false) \
+      printf(__VA_ARGS__); \
+  } while (false)
+
+#define ESP_LOGE(tag, ...) \
+  do { \
+    fprintf(stderr, "[E][%s] ", tag); \
+    fprintf(stderr, __VA_ARGS__); \
+    fputc('\n', stderr); \
+  } while (false)
+#define ESP_LOGW(tag, ...) ESP_LOG_QUIET_(tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ESP_LOG_QUIET_(tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ESP_LOG_QUIET_(tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ESP_LOG_QUIET_(tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) ESP_LOG_QUIET_(tag, __VA_ARGS__)
@@ -0,0 +1,24 @@
+#pragma once
+
+// Host test stand-in for ESPHome's preferences.h: nothing is stored, nothing restored
+
+#include <cstdint>
+
+namespace esphome {
+
+class ESPPreferenceObject {
+ public:
+  template<typename T> bool save(const T *src) { return true; }
+  template<typename T> bool load(T *dest) { return false; }
+};
+
+class ESPPreferences {
+ public:
+  template<typename T> ESPPreferenceObject make_preference(uint32_t type, bool in_flash) { return {}; }
+  template<typename T> ESPPreferenceObject make_preference(uint32_t type) { return {}; }
+  bool sync() { return true; }
+};
+
+inline ESPPreferences *global_preferences = new ESPPreferences();
+
+}  // namespace esphome
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Replay a Victron GX's SunSpec access pattern against the server and report latency.
+
+Each client behaves like a GX: it checks the "SunS" marker at 40000, walks the
+model chain to the end marker, then polls Model 103 (and Model 160 when present)
+at a fixed rate and periodically writes the Model 123 power limit with a revert
+timeout. Requests on one connection are sequential, like the GX's.
+
+Standard library only, so it runs anywhere Python 3.8+ does:
+
+    # Linux host build (esphome run sunspec-host.yaml)
+    python3 tools/gx_loadgen.py 127.0.0.1 --port 5020 --clients 4 --duration 60
+
+    # a device on the network, two inverters behind one ESP
+    python3 tools/gx_loadgen.py 192.168.1.50 --unit 126 --unit 127 --rate 5
+"""
+
+import argparse
+import asyncio
+import random
+import struct
+import sys
+import time
+
+BASE_ADDRESS = 40000
+SUNS = (0x5375, 0x6E53)
+END_MODEL = 0xFFFF
+
+FC_READ_HOLDING = 0x03
+FC_WRITE_MULTIPLE = 0x10
+
+# Model 123 offsets from its data start (see sunspec_registers.h)
+M123_WMAXLIMPCT = 3  # WMaxLimPct, WinTms, RvrtTms, RmpTms, WMaxLim_Ena
+
+
+class ModbusException(Exception):
+    def __init__(self, code):
+        super().__init__(f"exception {code:02X}")
+        self.code = code
+
+
+class Stats:
+    def __init__(self):
+        self.latencies = []  # seconds, successful requests only
+        self.requests = 0
+        self.timeouts = 0
+        self.exceptions = {}
+        self.disconnects = 0
+        self.writes = 0
+
+    def merge(self, other):
+        self.latencies += other.latencies
+        self.requests += other.requests
+        self.timeouts += other.timeouts
+        self.disconnects += other.disconnects
+        self.writes += other.writes
+        for code, count in other.exceptions.items():
+            self.exceptions[code] = self.exceptions.get(code, 0) + count
+
+
+class GxClient:
+    def __init__(self, args, unit, stats):
+        self.args = args
+        self.unit = unit
+        self.stats = stats
+        self.transaction = random.randrange(0x10000)
+        self.reader = None
+        self.writer = None
+        self.models = {}  # model ID -> (header offset, length)
+
+    async def connect(self):
+        self.reader, self.writer = await asyncio.wait_for(
+            asyncio.open_connection(self.args.host, self.args.port), self.args.timeout
+        )
+
+    def close(self):
+        if self.writer is not None:
+            self.writer.close()
+            self.writer = None
+
+    async def request(self, pdu):
+        """Send one PDU, return the response PDU; raises on timeout or exception response."""
+        self.transaction = (self.transaction + 1) & 0xFFFF
+        frame = struct.pack(">HHHB", self.transaction, 0, len(pdu) + 1, self.unit) + pdu
+        self.stats.requests += 1
+        start = time.perf_counter()
+        self.writer.write(frame)
+        try:
+            header = await asyncio.wait_for(self.reader.readexactly(7), self.args.timeout)
+            transaction, _, length, _ = struct.unpack(">HHHB", header)
+            body = await asyncio.wait_for(self.reader.readexactly(length - 1), self.args.timeout)
+        except asyncio.TimeoutError:
+            self.stats.timeouts += 1
+            raise
+        if transaction != self.transaction:
+            raise ConnectionError(f"transaction ID {transaction} != {self.transaction}")
+        if body[0] & 0x80:
+            self.stats.exceptions[body[1]] = self.stats.exceptions.get(body[1], 0) + 1
+            raise ModbusException(body[1])
+        self.stats.latencies.append(time.perf_counter() - start)
+        return body
+
+    async def read(self, offset, count):
+        body = await self.request(struct.pack(">BHH", FC_READ_HOLDING, BASE_ADDRESS + offset, count))
+        return struct.unpack(f">{count}H", body[2 : 2 + count * 2])
+
+    async def write(self, offset, values):
+        pdu = struct.pack(f">BHHB{len(values)}H", FC_WRITE_MULTIPLE, BASE_ADDRESS + offset, len(values),
+                          len(values) * 2, *values)
+        await self.request(pdu)
+        self.stats.writes += 1
+
+    async def discover(self):
+        if tuple(await self.read(0, 2)) != SUNS:
+            raise ConnectionError("no SunS marker at 40000")
+        offset = 2
+        self.models = {}
+        while True:
+            model_id, length = await self.read(offset, 2)
+            if model_id == END_MODEL:
+                break
+            self.models[model_id] = (offset, length)
+            offset += 2 + length
+        if 103 not in self.models:
+            raise ConnectionError("no Model 103 in the chain")
+
+    async def write_power_limit(self):
+        offset, _ = self.models[123]
+        pct = random.choice((100, 80, 50, 20, 0))
+        # WMaxLimPct, WinTms, RvrtTms, RmpTms, WMaxLim_Ena
+        await self.write(offset + 2 + M123_WMAXLIMPCT, (pct, 0, self.args.revert, 0, 1))
+
+    async def run(self, deadline):
+        period = 1.0 / self.args.rate
+        while time.monotonic() < deadline:
+            try:
+                await self.connect()
+                await self.discover()
+                next_poll = time.monotonic()
+                next_write = next_poll + random.uniform(0, self.args.control_interval)
+                while time.monotonic() < deadline:
+                    try:
+                        for model_id in (103, 160):
+                            if model_id in self.models:
+                                offset, length = self.models[model_id]
+                                await self.read(offset, 2 + length)
+                        if 123 in self.models and self.args.control_interval > 0 and time.monotonic() >= next_write:
+                            next_write += self.args.control_interval
+                            await self.write_power_limit()
+                    except ModbusException:
+                        pass  # counted; the GX keeps the connection too
+                    next_poll += period
+                    await asyncio.sleep(max(0.0, next_poll - time.monotonic()))
+            except ModbusException:
+                self.stats.disconnects += 1  # discovery failed
+                await asyncio.sleep(1.0)
+            except (OSError, ConnectionError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+                self.stats.disconnects += 1
+                await asyncio.sleep(1.0)  # the GX reconnects after a pause too
+            finally:
+                self.close()
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(len(sorted_values) * pct / 100.0))
+    return sorted_values[index]
+
+
+def report(stats, elapsed, clients):
+    latencies = sorted(stats.latencies)
+    ok = len(latencies)
+    print(f"clients      {clients}")
+    print(f"duration     {elapsed:.1f} s")
+    print(f"requests     {stats.requests} ({ok / elapsed:.1f}/s answered, {stats.writes} power limit writes)")
+    print(f"timeouts     {stats.timeouts}")
+    print(f"exceptions   {sum(stats.exceptions.values())}"
+          + "".join(f"  [{code:02X}: {count}]" for code, count in sorted(stats.exceptions.items())))
+    print(f"disconnects  {stats.disconnects}")
+    if ok:
+        print("latency ms   p50 {:.2f}  p99 {:.2f}  p999 {:.2f}  max {:.2f}".format(
+            *(1000 * percentile(latencies, p) for p in (50, 99, 99.9)), 1000 * latencies[-1]))
+
+
+async def main(args):
+    units = args.unit or [126]
+    deadline = time.monotonic() + args.duration
+    clients = [GxClient(args, units[i % len(units)], Stats()) for i in range(args.clients)]
+    start = time.monotonic()
+    await asyncio.gather(*(client.run(deadline) for client in clients))
+    total = Stats()
+    for client in clients:
+        total.merge(client.stats)
+    report(total, time.monotonic() - start, len(clients))
+    return 1 if total.timeouts or total.disconnects or total.exceptions else 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=502)
+    parser.add_argument("--unit", type=int, action="append", help="unit ID, repeat to spread clients over devices (126)")
+    parser.add_argument("--clients", type=int, default=1, help="concurrent connections (1)")
+    parser.add_argument("--rate", type=float, default=1.0, help="poll cycles per second per client (1)")
+    parser.add_argument("--duration", type=float, default=30.0, help="seconds (30)")
+    parser.add_argument("--control-interval", type=float, default=5.0,
+                        help="seconds between Model 123 writes per client, 0 = never (5)")
+    parser.add_argument("--revert", type=int, default=60, help="WMaxLimPct_RvrtTms written with each limit (60)")
+    parser.add_argument("--timeout", type=float, default=1.0, help="per-request timeout in seconds (1)")
+    sys.exit(asyncio.run(main(parser.parse_args())))
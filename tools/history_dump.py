@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Read the on-device sample history and print it as CSV.
+
+The history window is a read-only vendor block at 41000 (see
+docs/SUNSPEC_REGISTERS.md). Samples are printed oldest first with the wall-clock
+time they were taken, so the output can backfill a gap in a time series:
+
+    python3 tools/history_dump.py 192.168.1.50 --unit 126 > history.csv
+    python3 tools/history_dump.py 192.168.1.50 --after 1234   # only samples newer than #1234
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+FIELDS = ["time", "ac_power_w", "energy_wh", "dc_voltage_1", "dc_current_1", "dc_voltage_2", "dc_current_2",
+          "temperature_c", "state"]
+SCALE = {"dc_voltage_1": 0.1, "dc_current_1": 0.01, "dc_voltage_2": 0.1, "dc_current_2": 0.01}
+HISTORY_ADDRESS = 41000
+HEADER_REGISTERS = 8
+MAX_READ = 125
+
+
+class Client:
+    def __init__(self, host, port, unit, timeout):
+        self.sock = socket.create_connection((host, port), timeout)
+        self.unit = unit
+        self.transaction = 0
+
+    def read(self, address, count):
+        self.transaction = (self.transaction + 1) & 0xFFFF
+        self.sock.sendall(struct.pack(">HHHBBHH", self.transaction, 0, 6, self.unit, 3, address, count))
+        header = self._recv(7)
+        body = self._recv(struct.unpack(">H", header[4:6])[0] - 1)
+        if body[0] & 0x80:
+            raise RuntimeError(f"exception {body[1]:02X} reading {address}")
+        return body[2:]
+
+    def _recv(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("connection closed")
+            data += chunk
+        return data
+
+
+def unzigzag_varints(data, pos, count):
+    values = []
+    for _ in range(count):
+        value = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        values.append((value >> 1) ^ -(value & 1))
+    return values, pos
+
+
+def decode_block(block):
+    used, first_sequence = struct.unpack(">HI", block[:6])
+    samples = []
+    previous = [0] * len(FIELDS)
+    pos = 6
+    while pos < used:
+        deltas, pos = unzigzag_varints(block, pos, len(FIELDS))
+        previous = [(p + d) & 0xFFFFFFFF for p, d in zip(previous, deltas)]
+        samples.append([v - (1 << 32) if v & 0x80000000 else v for v in previous])
+    return first_sequence, samples
+
+
+def read_window(client, start, first, count):
+    data = b""
+    while count > 0:
+        n = min(count, MAX_READ)
+        data += client.read(start + first, n)
+        first += n
+        count -= n
+    return data
+
+
+def main(args):
+    client = Client(args.host, args.port, args.unit, args.timeout)
+    start = args.address
+    try:
+        header = client.read(start, HEADER_REGISTERS)
+    except RuntimeError:
+        sys.exit(f"no history window at {start} (is history: configured?)")
+    read_at = time.time()
+    newest, blocks, block_regs, current, interval, age = struct.unpack(">IHHHHI", header)
+    if newest == 0:
+        return
+
+    # Oldest block first
+    samples = []
+    for i in range(1, blocks + 1):
+        index = (current + i) % blocks
+        block = read_window(client, start, HEADER_REGISTERS + index * block_regs, block_regs)
+        first_sequence, decoded = decode_block(block)
+        if first_sequence == 0:
+            continue  # never written
+        samples += [(first_sequence + n, sample) for n, sample in enumerate(decoded)]
+
+    # A block appended or recycled during the reads shows up as a duplicate or gap
+    # in sequence numbers; keep each sequence number once
+    by_sequence = dict(samples)
+    newest_time = max(sample[0] for sample in by_sequence.values())
+    writer = sys.stdout
+    writer.write("sequence,timestamp," + ",".join(FIELDS[1:]) + "\n")
+    for sequence in sorted(by_sequence):
+        if sequence <= args.after or sequence > newest:
+            continue  # newer than the header (appended while reading): next run
+        sample = by_sequence[sequence]
+        timestamp = read_at - age - (newest_time - sample[0])
+        values = [round(v * SCALE.get(name, 1), 2) for name, v in zip(FIELDS[1:], sample[1:])]
+        writer.write(f"{sequence},{time.strftime('%Y-%m-%dT%H:%M:%S', time.localtime(timestamp))},"
+                     + ",".join(str(v) for v in values) + "\n")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=502)
+    parser.add_argument("--unit", type=int, default=126)
+    parser.add_argument("--address", type=int, default=HISTORY_ADDRESS, help="history window address (41000)")
+    parser.add_argument("--after", type=int, default=0, help="only samples with a higher sequence number")
+    parser.add_argument("--timeout", type=float, default=2.0)
+    main(parser.parse_args())